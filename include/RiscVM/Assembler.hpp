@@ -46,6 +46,10 @@ namespace RiscVM
     struct LinkInfo
     {
         std::vector<SectionLinkInfo> Sections;
+        /**
+         * Filled by the linker with the final address of every defined label.
+         */
+        SymbolMap Symbols;
     };
 
     class Assembler
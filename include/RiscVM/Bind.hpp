@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <RiscVM/ISA.hpp>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * How a parameter of a bound host function is taken from the guest. Registers is how many
+     * of a0..a7 it consumes; Take() reads them and fails for a guest pointer that does not lie in
+     * guest memory.
+     *
+     *   integer, enum     one register
+     *   VM&               the calling VM, no register
+     *   std::span<T>      a guest pointer and an element count, two registers
+     *   std::string_view  a guest pointer to a NUL-terminated string, one register
+     */
+    template <typename T>
+    struct Argument
+    {
+        static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "a bound parameter is an integer, an enum, VM&, a std::span or a std::string_view");
+
+        typedef T Type;
+        static constexpr uint32_t Registers = 1;
+
+        static bool Take(VM&, const int32_t* args, Type& value)
+        {
+            value = static_cast<T>(args[0]);
+            return true;
+        }
+
+        static T Pass(const Type& value)
+        {
+            return value;
+        }
+    };
+
+    template <>
+    struct Argument<VM>
+    {
+        typedef VM* Type;
+        static constexpr uint32_t Registers = 0;
+
+        static bool Take(VM& vm, const int32_t*, Type& value)
+        {
+            value = &vm;
+            return true;
+        }
+
+        static VM& Pass(const Type& value)
+        {
+            return *value;
+        }
+    };
+
+    template <typename T>
+    struct Argument<std::span<T>>
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "a bound span views plain guest data");
+
+        typedef std::span<T> Type;
+        static constexpr uint32_t Registers = 2;
+
+        static bool Take(VM& vm, const int32_t* args, Type& value)
+        {
+            const auto address = static_cast<uint32_t>(args[0]);
+            const auto count = static_cast<uint32_t>(args[1]);
+            if (address + uint64_t{count} * sizeof(T) > vm.MemorySize())
+                return false;
+            value = Type(reinterpret_cast<T*>(vm.Memory() + address), count);
+            return true;
+        }
+
+        static Type Pass(const Type& value)
+        {
+            return value;
+        }
+    };
+
+    template <>
+    struct Argument<std::string_view>
+    {
+        typedef std::string_view Type;
+        static constexpr uint32_t Registers = 1;
+
+        static bool Take(VM& vm, const int32_t* args, Type& value)
+        {
+            const auto address = static_cast<uint32_t>(args[0]);
+            if (address >= vm.MemorySize())
+                return false;
+            const auto begin = vm.Memory() + address;
+            const auto end = static_cast<const char*>(memchr(begin, 0, vm.MemorySize() - address));
+            if (!end)
+                return false;
+            value = Type(begin, end - begin);
+            return true;
+        }
+
+        static Type Pass(const Type& value)
+        {
+            return value;
+        }
+    };
+
+    template <auto F, typename = decltype(F)>
+    struct Binder;
+
+    template <auto F, typename R, typename... P>
+    struct Binder<F, R (*)(P...)>
+    {
+        // the first argument register of every parameter, counted from a0, and the total
+        static constexpr auto Offsets = []
+        {
+            std::array<uint32_t, sizeof...(P) + 1> offsets{};
+            uint32_t i = 0;
+            ((offsets[i + 1] = offsets[i] + Argument<std::remove_cvref_t<P>>::Registers, ++i), ...);
+            return offsets;
+        }();
+        static_assert(Offsets.back() <= a7 - a0 + 1, "a bound function takes its parameters from a0..a7");
+        static_assert(std::is_void_v<R> || std::is_integral_v<R> || std::is_enum_v<R>, "a bound function returns nothing or an integer for a0");
+
+        static void Invoke(VM& vm)
+        {
+            Call(vm, std::index_sequence_for<P...>{});
+        }
+
+        template <size_t... I>
+        static void Call(VM& vm, std::index_sequence<I...>)
+        {
+            const auto args = vm.Registers() + a0;
+            std::tuple<typename Argument<std::remove_cvref_t<P>>::Type...> values;
+            if (!(Argument<std::remove_cvref_t<P>>::Take(vm, args + Offsets[I], std::get<I>(values)) && ...))
+            {
+                vm.Fault();
+                return;
+            }
+
+            if constexpr (std::is_void_v<R>)
+                F(Argument<std::remove_cvref_t<P>>::Pass(std::get<I>(values))...);
+            else
+                vm.R<a0>() = static_cast<int32_t>(F(Argument<std::remove_cvref_t<P>>::Pass(std::get<I>(values))...));
+        }
+    };
+
+    /**
+     * An ecall handler that calls the host function F with its parameters taken from a0..a7 in
+     * order, see Argument, and writes what it returns to a0. The marshalling is resolved at
+     * compile time into a plain function, so ECallTable dispatches it without type erasure. A
+     * guest pointer outside guest memory stops the guest with Stop_Fault before F runs.
+     *
+     *   int32_t Random(int32_t min, int32_t max);
+     *   ecall_map.Set(120, Bind<&Random>);
+     */
+    template <auto F>
+    constexpr ECallTable::Function Bind = &Binder<F>::Invoke;
+}
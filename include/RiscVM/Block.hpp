@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <RiscVM/Op.hpp>
+
+namespace RiscVM
+{
+    /**
+     * A run of guest instructions ending at a control transfer (JAL, JALR, Bxx, ECALL, EBREAK),
+     * at an undecodable word or at a page boundary. Ops has one extra Handler_Invalid slot at the
+     * end, so falling off the block looks the same as reaching an undecodable word.
+     * Chain[0] caches the fall-through / not-taken successor, Chain[1] the taken or indirect one.
+     * Heat counts dispatches into the block; Native is its entry in the JIT code cache, if any.
+     */
+    struct Block
+    {
+        uint32_t Begin = 0;
+        uint32_t Size = 0;
+        bool Valid = true;
+        uint32_t Heat = 0;
+        uint8_t* Native = nullptr;
+
+        Block* Chain[2]{};
+        std::vector<Op> Ops;
+    };
+}
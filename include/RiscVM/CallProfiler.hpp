@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include <RiscVM/RiscVM.hpp>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * Attributes every retired instruction to the guest call stack it ran under. The stack is a
+     * shadow kept from the link register convention of call and ret: a jal or jalr that writes ra
+     * enters the function at its target, a jalr zero,0(ra) leaves back to the frame whose return
+     * address it lands on. Other jumps, tail calls included, stay in the current frame. Like
+     * Profiler it is a Tracer for one VM at a time.
+     */
+    class CallProfiler : public Tracer
+    {
+    public:
+        CallProfiler();
+
+        void Retire(VM& vm, uint32_t pc, const Op& op) override;
+
+        void Clear();
+        /**
+         * One "outer;inner;leaf count" line per distinct stack that retired instructions itself,
+         * the folded format flame graph tools read.
+         */
+        void WriteFolded(std::ostream& stream, const SymbolMap& symbols = {}) const;
+        /**
+         * The top functions by inclusive count, with their exclusive count. A recursive function
+         * is counted once per outermost activation, so inclusive never exceeds the total.
+         */
+        void Report(std::ostream& stream, const SymbolMap& symbols = {}, size_t top = 20) const;
+
+    private:
+        // a node per distinct call path; recursion makes a path per depth
+        struct Node
+        {
+            uint32_t Function;
+            uint32_t Parent;
+            uint64_t Self = 0;
+            std::unordered_map<uint32_t, uint32_t> Children;
+        };
+
+        struct Frame
+        {
+            uint32_t Node;
+            uint32_t Return;
+        };
+
+        enum Pending
+        {
+            Pending_None,
+            Pending_Call,
+            Pending_Return,
+        };
+
+        void Enter(uint32_t function, uint32_t ret);
+        void Leave(uint32_t pc);
+
+        std::vector<Node> m_Nodes;
+        std::vector<Frame> m_Stack;
+        // the transfer the previous instruction made, resolved once its target retires
+        Pending m_Pending = Pending_None;
+        uint32_t m_Return = 0;
+        bool m_Started = false;
+    };
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <RiscVM/ECallTable.hpp>
+
+namespace RiscVM
+{
+    /**
+     * Buffered character device behind the console ecalls of one VM. Output collects in a
+     * buffer that is handed to the sink according to the flush policy; input is prefetched from
+     * the source a buffer at a time. Each VM has its own, see VM::IO(), so VMs on different
+     * threads never share a buffer or a stdio lock unless their sinks do.
+     *
+     * Pending output is always flushed before the console blocks on its source, so a prompt
+     * shows before the input it asks for, and when the guest stops.
+     *
+     * Install() registers the console ecalls:
+     *
+     *   0  putc   a0 = character
+     *   1  puts   a0 = NUL-terminated string
+     *   2  printf a0 = format, a1 = argument area
+     *   3  getc   a0 = next character, or -1 at the end of the input
+     *   4  fgets  a0 = buffer, a1 = its size
+     *   5  scanf  a0 = format, a1 = argument area
+     *
+     * A string, buffer or argument area that does not start inside guest memory stops the guest
+     * with Stop_Fault.
+     */
+    class Console
+    {
+    public:
+        enum Flushing
+        {
+            Flush_Line, // at every newline, the behavior of a terminal
+            Flush_Size, // whenever the buffer is full
+            Flush_Exit, // only when the guest stops or reads input; the buffer grows as needed
+        };
+
+        /**
+         * Takes size bytes of output.
+         */
+        typedef std::function<void(const char* data, size_t size)> Sink;
+        /**
+         * Fills up to size bytes of buffer and returns how many it filled, 0 at the end of the
+         * input. May return fewer than asked for, e.g. a line of a terminal.
+         */
+        typedef std::function<size_t(char* buffer, size_t size)> Source;
+
+        static constexpr size_t BufferSize = 64 * 1024;
+
+        /**
+         * A console on the host's stdout and stdin.
+         */
+        Console();
+        /**
+         * Flushes.
+         */
+        ~Console();
+
+        Console(const Console&) = delete;
+        Console& operator=(const Console&) = delete;
+
+        static Sink FileSink(FILE* file);
+        /**
+         * Reads the file's descriptor directly, so input is not buffered twice and a terminal
+         * returns a line as soon as it is entered.
+         */
+        static Source FileSource(FILE* file);
+        static Sink StringSink(std::string& output);
+        static Source StringSource(std::string input);
+
+        Sink& Output();
+        Source& Input();
+        Flushing& FlushPolicy();
+
+        static void Install(ECallTable& ecall_map);
+
+        void Put(const char c)
+        {
+            m_Out.push_back(c);
+            if ((c == '\n' && m_Policy == Flush_Line) || (m_Out.size() >= BufferSize && m_Policy != Flush_Exit))
+                Flush();
+        }
+
+        void Write(std::string_view data);
+        void Print(const char* format, va_list args);
+
+        /**
+         * The next input character as an unsigned char, or -1 at the end of the input.
+         */
+        int Get()
+        {
+            if (m_InBegin == m_InEnd && !Fill())
+                return -1;
+            return static_cast<unsigned char>(m_In[m_InBegin++]);
+        }
+
+        /**
+         * fgets(): reads up to size - 1 characters, through the next newline, and terminates
+         * them. False, leaving buffer as it is, if the input had already ended.
+         */
+        bool GetLine(char* buffer, size_t size);
+        /**
+         * Parses the next line of input with vsscanf() and returns its result. Unlike
+         * vfscanf() it never reads past that line, the way a terminal hands over input.
+         */
+        int Scan(const char* format, va_list args);
+
+        void Flush();
+        /**
+         * Drops buffered input and output that was not flushed yet, e.g. before the console
+         * moves on to another source and sink.
+         */
+        void Discard();
+
+    private:
+        bool Fill();
+
+        std::string m_Out;
+        std::unique_ptr<char[]> m_In;
+        size_t m_InSize = BufferSize;
+        size_t m_InBegin = 0;
+        size_t m_InEnd = 0;
+        bool m_Ended = false;
+
+        Sink m_Sink;
+        Source m_Source;
+        Flushing m_Policy = Flush_Line;
+    };
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * Deterministic record and replay of the host side of a run. Record() wraps every handler in
+     * a VM's ecall table so that each call logs what it did to the guest: the registers it
+     * changed, Ok() and Status(), and the guest bytes it wrote. Replay() swaps the handlers for
+     * ones that apply the logged effects in order without calling the host, so input, random
+     * numbers and anything else a handler brings in come out the same, and the guest retires
+     * exactly the instructions it did when recorded. Output a handler only sends to the host is
+     * not reproduced, and neither is Yield().
+     *
+     * On a VM loaded with DirtyTracking() on, recording watches the pages each call writes, see
+     * VM::Watch(), and only compares those with what they held before, however large guest
+     * memory is: a handler's first write to a page the guest never wrote costs a fault, and
+     * the pages the guest did write are copied and compared while there are few of them, or
+     * else write-protected again for the call. Without tracking, recording compares all of
+     * guest memory against a shadow copy before and after each call. Replaying costs a table
+     * lookup and the writes.
+     */
+    class ECallLog
+    {
+    public:
+        struct Effect
+        {
+            // where the ecall retired and the number it was made with, to catch a diverging replay
+            uint32_t PC = 0;
+            int32_t Number = 0;
+            bool Ok = true;
+            int32_t Status = 0;
+            // registers the handler changed and their new values
+            std::vector<std::pair<uint32_t, int32_t>> Registers;
+            // runs of guest bytes the handler changed, by address
+            std::vector<std::pair<uint32_t, std::string>> Writes;
+        };
+
+        /**
+         * Wraps the handlers currently in vm's ecall table. The log must outlive the run.
+         */
+        void Record(VM& vm);
+        /**
+         * Replaces the handlers currently in vm's ecall table, starting over at the first effect.
+         * A replay that reaches an ecall the log does not have next throws std::runtime_error out
+         * of Run().
+         */
+        void Replay(VM& vm);
+
+        [[nodiscard]] const std::vector<Effect>& Effects() const;
+
+        void Write(std::ostream& stream) const;
+        /**
+         * Throws std::runtime_error on anything Write() did not produce.
+         */
+        static ECallLog Read(std::istream& stream);
+
+    private:
+        void Sync(const VM& vm);
+        void Diff(const VM& vm, Effect& effect);
+        void SyncWritten(const VM& vm);
+        void DiffWritten(const VM& vm, Effect& effect);
+        void Apply(VM& vm, int number);
+
+        std::vector<Effect> m_Effects;
+        size_t m_Next = 0;
+
+        std::unique_ptr<char, decltype(&free)> m_Shadow{nullptr, &free};
+        size_t m_ShadowSize = 0;
+        // copies of the few pages the guest wrote before the current call, by host page
+        std::vector<uint32_t> m_Written;
+        std::unordered_map<uint32_t, std::unique_ptr<char[]>> m_Pages;
+    };
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace RiscVM
+{
+    class VM;
+
+    typedef std::function<void(VM& vm)> ECall;
+
+    /**
+     * Ecall handlers by number, the a7 of the ecall, from 0 to Size - 1. Dispatch indexes a flat
+     * array with it: a handler without state, a captureless lambda or Bind<&fn>, is a plain
+     * function pointer and costs one indirect call; anything else is kept as an ECall next to
+     * it. A number nobody handles stops the guest with Stop_Fault.
+     */
+    class ECallTable
+    {
+    public:
+        static constexpr uint32_t Size = 256;
+
+        typedef void (*Function)(VM& vm);
+
+        ECallTable() = default;
+        ECallTable(const ECallTable& other);
+        ECallTable& operator=(const ECallTable& other);
+        ECallTable(ECallTable&&) noexcept = default;
+        ECallTable& operator=(ECallTable&&) noexcept = default;
+
+        /**
+         * Installs handler for number, replacing what was there. Throws std::out_of_range for a
+         * number outside the table.
+         */
+        template <typename F>
+        void Set(const int number, F&& handler)
+        {
+            const auto n = Index(number);
+            if constexpr (std::is_convertible_v<F, Function>)
+            {
+                m_Functions[n] = handler;
+                if (m_Closures)
+                    m_Closures[n] = nullptr;
+            }
+            else
+            {
+                if (!m_Closures)
+                    m_Closures = std::make_unique<ECall[]>(Size);
+                m_Closures[n] = ECall(std::forward<F>(handler));
+                m_Functions[n] = nullptr;
+            }
+        }
+
+        void Erase(int number);
+        [[nodiscard]] bool Contains(int number) const;
+        /**
+         * The handler for number as an ECall, empty if there is none.
+         */
+        [[nodiscard]] ECall Get(int number) const;
+        /**
+         * Numbers that have a handler, in ascending order.
+         */
+        [[nodiscard]] std::vector<int> Numbers() const;
+
+        /**
+         * Runs the handler for number. False if there is none.
+         */
+        bool Call(VM& vm, const int32_t number) const
+        {
+            const auto n = static_cast<uint32_t>(number);
+            if (n >= Size)
+                return false;
+            if (const auto function = m_Functions[n])
+            {
+                function(vm);
+                return true;
+            }
+            if (m_Closures && m_Closures[n])
+            {
+                m_Closures[n](vm);
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        static uint32_t Index(int number);
+
+        Function m_Functions[Size]{};
+        // allocated once the first closure is set and never moved after, so a handler may
+        // change the other entries while it runs
+        std::unique_ptr<ECall[]> m_Closures;
+    };
+}
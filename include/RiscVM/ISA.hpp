@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <iterator>
 #include <string>
+#include <RiscVM/Op.hpp>
 
 namespace RiscVM
 {
@@ -100,151 +102,214 @@ namespace RiscVM
         s9 = 25, s10 = 26, s11 = 27, t3 = 28, t4 = 29, t5 = 30, t6 = 31
     };
 
-    namespace Format
+    constexpr uint32_t ImmBits(const uint32_t data, const uint32_t end, const uint32_t beg)
     {
-        union R
-        {
-            void Dump() const;
-
-            struct
-            {
-                uint32_t Opcode : 7;
-                uint32_t Rd : 5;
-                uint32_t Func3 : 3;
-                uint32_t Rs1 : 5;
-                uint32_t Rs2 : 5;
-                uint32_t Func7 : 7;
-            };
-
-            uint32_t Data;
-        };
-
-        union I
-        {
-            [[nodiscard]] int32_t Immediate() const;
-            [[nodiscard]] uint32_t UImmediate() const;
-
-            void Immediate(int32_t);
-
-            void Dump() const;
-
-            struct
-            {
-                uint32_t Opcode : 7;
-                uint32_t Rd : 5;
-                uint32_t Func3 : 3;
-                uint32_t Rs1 : 5;
-                uint32_t Imm_10_0 : 11;
-                uint32_t Imm_11 : 1;
-            };
-
-            uint32_t Data;
-        };
+        return (data >> beg) & ((2u << (end - beg)) - 1);
+    }
 
-        union S
-        {
-            [[nodiscard]] int32_t Immediate() const;
-            [[nodiscard]] uint32_t UImmediate() const;
+    constexpr uint32_t Extend(const uint32_t bit, const uint32_t n)
+    {
+        return n < 32 ? (0u - bit) & ((1u << n) - 1) : 0u - bit;
+    }
 
-            void Immediate(int32_t);
+    constexpr uint32_t Rd(const uint32_t data) { return data >> 7 & 0b11111; }
+    constexpr uint32_t Rs1(const uint32_t data) { return data >> 15 & 0b11111; }
+    constexpr uint32_t Rs2(const uint32_t data) { return data >> 20 & 0b11111; }
 
-            void Dump() const;
+    // the sign bit of every immediate is bit 31, so an arithmetic shift does the extension
+    constexpr int32_t ImmediateI(const uint32_t data)
+    {
+        return static_cast<int32_t>(data) >> 20;
+    }
 
-            struct
-            {
-                uint32_t Opcode : 7;
-                uint32_t Imm_4_0 : 5;
-                uint32_t Func3 : 3;
-                uint32_t Rs1 : 5;
-                uint32_t Rs2 : 5;
-                uint32_t Imm_10_5 : 6;
-                uint32_t Imm_11 : 1;
-            };
+    constexpr int32_t ImmediateS(const uint32_t data)
+    {
+        return static_cast<int32_t>(data & 0xfe000000) >> 20 | static_cast<int32_t>(data >> 7 & 0b11111);
+    }
 
-            uint32_t Data;
-        };
+    constexpr int32_t ImmediateB(const uint32_t data)
+    {
+        return static_cast<int32_t>(data & 0x80000000) >> 19
+            | static_cast<int32_t>((data << 4 & 0x800) | (data >> 20 & 0x7e0) | (data >> 7 & 0x1e));
+    }
 
-        union B
-        {
-            [[nodiscard]] int32_t Immediate() const;
-            [[nodiscard]] uint32_t UImmediate() const;
+    constexpr int32_t ImmediateU(const uint32_t data)
+    {
+        return static_cast<int32_t>(data & 0xfffff000);
+    }
 
-            void Immediate(int32_t);
+    constexpr int32_t ImmediateJ(const uint32_t data)
+    {
+        return static_cast<int32_t>(data & 0x80000000) >> 11
+            | static_cast<int32_t>((data & 0xff000) | (data >> 9 & 0x800) | (data >> 20 & 0x7fe));
+    }
 
-            void Dump() const;
+    constexpr uint32_t UImmediateI(const uint32_t data)
+    {
+        return data >> 20;
+    }
 
-            struct
-            {
-                uint32_t Opcode : 7;
-                uint32_t Imm_11 : 1;
-                uint32_t Imm_4_1 : 4;
-                uint32_t Func3 : 3;
-                uint32_t Rs1 : 5;
-                uint32_t Rs2 : 5;
-                uint32_t Imm_10_5 : 6;
-                uint32_t Imm_12 : 1;
-            };
+    constexpr uint32_t EncodeRd(const uint32_t r) { return (r & 0b11111) << 7; }
+    constexpr uint32_t EncodeRs1(const uint32_t r) { return (r & 0b11111) << 15; }
+    constexpr uint32_t EncodeRs2(const uint32_t r) { return (r & 0b11111) << 20; }
 
-            uint32_t Data;
-        };
+    constexpr uint32_t EncodeI(const int32_t imm)
+    {
+        return static_cast<uint32_t>(imm) << 20;
+    }
 
-        union U
-        {
-            [[nodiscard]] int32_t Immediate() const;
-            [[nodiscard]] uint32_t UImmediate() const;
+    constexpr uint32_t EncodeS(const int32_t imm)
+    {
+        const auto u = static_cast<uint32_t>(imm);
+        return (u & 0xfe0) << 20 | (u & 0b11111) << 7;
+    }
 
-            void Immediate(int32_t);
+    constexpr uint32_t EncodeB(const int32_t imm)
+    {
+        const auto u = static_cast<uint32_t>(imm);
+        return (u & 0x1000) << 19 | (u & 0x7e0) << 20 | (u & 0x1e) << 7 | (u & 0x800) >> 4;
+    }
 
-            void Dump() const;
+    constexpr uint32_t EncodeU(const int32_t imm)
+    {
+        return static_cast<uint32_t>(imm) & 0xfffff000;
+    }
 
-            struct
-            {
-                uint32_t Opcode : 7;
-                uint32_t Rd : 5;
-                uint32_t Imm_30_12 : 19;
-                uint32_t Imm_31 : 1;
-            };
+    constexpr uint32_t EncodeJ(const int32_t imm)
+    {
+        const auto u = static_cast<uint32_t>(imm);
+        return (u & 0x100000) << 11 | (u & 0x7fe) << 20 | (u & 0x800) << 9 | (u & 0xff000);
+    }
 
-            uint32_t Data;
-        };
+    /**
+     * Operand layout of an instruction, shared by the decoder, Dump() and the assembler's Link().
+     * Stores keep their value in rs1 and their base in rs2, like the rest of the VM.
+     */
+    enum Format : uint8_t
+    {
+        Format_None,
+        Format_R, // rd,rs1,rs2
+        Format_I, // rd,rs1,imm
+        Format_Shift, // rd,rs1,shamt
+        Format_Load, // rd,imm(rs1), loads and jalr
+        Format_S, // rs1,imm(rs2)
+        Format_B, // rs1,rs2,imm
+        Format_U, // rd,imm
+        Format_J, // rd,imm
+        Format_Env, // no operands
+    };
 
-        union J
+    constexpr uint32_t FormatMask(const Format form)
+    {
+        switch (form)
         {
-            [[nodiscard]] int32_t Immediate() const;
-            [[nodiscard]] uint32_t UImmediate() const;
-
-            void Immediate(int32_t);
-
-            void Dump() const;
-
-            struct
-            {
-                uint32_t Opcode : 7;
-                uint32_t Rd : 5;
-                uint32_t Imm_19_12 : 8;
-                uint32_t Imm_11 : 1;
-                uint32_t Imm_10_1 : 10;
-                uint32_t Imm_20 : 1;
-            };
+        case Format_None: return 0;
+        case Format_R:
+        case Format_Shift: return 0xfe00707f;
+        case Format_U:
+        case Format_J: return 0x7f;
+        case Format_Env: return 0xffffffff;
+        default: return 0x707f;
+        }
+    }
 
-            uint32_t Data;
-        };
+    // ISA keys pack opcode | funct3 << 7 | funct7 << 10; EBREAK carries its imm bit 20 as is
+    constexpr uint32_t KeyMatch(const uint32_t key)
+    {
+        return (key & 0x7f) | (key >> 7 & 0b111) << 12 | (key >> 10 & 0x7f) << 25 | (key & ~0x1ffffu);
     }
 
-    uint32_t ImmBits(uint32_t data, uint32_t end, uint32_t beg);
-    uint32_t Extend(uint32_t bit, uint32_t n);
+    /**
+     * One row of the instruction table. A word is this instruction if (word & Mask) == Match.
+     */
+    struct InstructionInfo
+    {
+        const char* Name;
+        uint32_t Key;
+        Handler Id;
+        Format Form;
+        uint32_t Mask;
+        uint32_t Match;
+    };
 
-    uint32_t Rd(uint32_t);
-    uint32_t Rs1(uint32_t);
-    uint32_t Rs2(uint32_t);
+    constexpr InstructionInfo MakeInfo(const char* name, const uint32_t key, const Handler id, const Format form)
+    {
+        return {name, key, id, form, FormatMask(form), KeyMatch(key) & FormatMask(form)};
+    }
 
-    int32_t ImmediateI(uint32_t);
-    int32_t ImmediateS(uint32_t);
-    int32_t ImmediateB(uint32_t);
-    int32_t ImmediateU(uint32_t);
-    int32_t ImmediateJ(uint32_t);
+    /**
+     * Every RV32IM instruction, indexed by its Handler. Handler_Invalid matches any word.
+     */
+    inline constexpr InstructionInfo Instructions[]
+    {
+        MakeInfo(nullptr, 0, Handler_Invalid, Format_None),
+
+        MakeInfo("lui", RV32I_LUI, Handler_LUI, Format_U),
+        MakeInfo("auipc", RV32I_AUIPC, Handler_AUIPC, Format_U),
+        MakeInfo("jal", RV32I_JAL, Handler_JAL, Format_J),
+        MakeInfo("jalr", RV32I_JALR, Handler_JALR, Format_Load),
+        MakeInfo("beq", RV32I_BEQ, Handler_BEQ, Format_B),
+        MakeInfo("bne", RV32I_BNE, Handler_BNE, Format_B),
+        MakeInfo("blt", RV32I_BLT, Handler_BLT, Format_B),
+        MakeInfo("bge", RV32I_BGE, Handler_BGE, Format_B),
+        MakeInfo("bltu", RV32I_BLTU, Handler_BLTU, Format_B),
+        MakeInfo("bgeu", RV32I_BGEU, Handler_BGEU, Format_B),
+        MakeInfo("lb", RV32I_LB, Handler_LB, Format_Load),
+        MakeInfo("lh", RV32I_LH, Handler_LH, Format_Load),
+        MakeInfo("lw", RV32I_LW, Handler_LW, Format_Load),
+        MakeInfo("lbu", RV32I_LBU, Handler_LBU, Format_Load),
+        MakeInfo("lhu", RV32I_LHU, Handler_LHU, Format_Load),
+        MakeInfo("sb", RV32I_SB, Handler_SB, Format_S),
+        MakeInfo("sh", RV32I_SH, Handler_SH, Format_S),
+        MakeInfo("sw", RV32I_SW, Handler_SW, Format_S),
+        MakeInfo("addi", RV32I_ADDI, Handler_ADDI, Format_I),
+        MakeInfo("slti", RV32I_SLTI, Handler_SLTI, Format_I),
+        MakeInfo("sltiu", RV32I_SLTIU, Handler_SLTIU, Format_I),
+        MakeInfo("xori", RV32I_XORI, Handler_XORI, Format_I),
+        MakeInfo("ori", RV32I_ORI, Handler_ORI, Format_I),
+        MakeInfo("andi", RV32I_ANDI, Handler_ANDI, Format_I),
+        MakeInfo("slli", RV32I_SLLI, Handler_SLLI, Format_Shift),
+        MakeInfo("srli", RV32I_SRLI, Handler_SRLI, Format_Shift),
+        MakeInfo("srai", RV32I_SRAI, Handler_SRAI, Format_Shift),
+        MakeInfo("add", RV32I_ADD, Handler_ADD, Format_R),
+        MakeInfo("sub", RV32I_SUB, Handler_SUB, Format_R),
+        MakeInfo("sll", RV32I_SLL, Handler_SLL, Format_R),
+        MakeInfo("slt", RV32I_SLT, Handler_SLT, Format_R),
+        MakeInfo("sltu", RV32I_SLTU, Handler_SLTU, Format_R),
+        MakeInfo("xor", RV32I_XOR, Handler_XOR, Format_R),
+        MakeInfo("srl", RV32I_SRL, Handler_SRL, Format_R),
+        MakeInfo("sra", RV32I_SRA, Handler_SRA, Format_R),
+        MakeInfo("or", RV32I_OR, Handler_OR, Format_R),
+        MakeInfo("and", RV32I_AND, Handler_AND, Format_R),
+        MakeInfo("fence", RV32I_FENCE, Handler_FENCE, Format_I),
+        MakeInfo("ecall", RV32I_ECALL, Handler_ECALL, Format_Env),
+        MakeInfo("ebreak", RV32I_EBREAK, Handler_EBREAK, Format_Env),
+
+        MakeInfo("mul", RV32M_MUL, Handler_MUL, Format_R),
+        MakeInfo("mulh", RV32M_MULH, Handler_MULH, Format_R),
+        MakeInfo("mulhsu", RV32M_MULHSU, Handler_MULHSU, Format_R),
+        MakeInfo("mulhu", RV32M_MULHU, Handler_MULHU, Format_R),
+        MakeInfo("div", RV32M_DIV, Handler_DIV, Format_R),
+        MakeInfo("divu", RV32M_DIVU, Handler_DIVU, Format_R),
+        MakeInfo("rem", RV32M_REM, Handler_REM, Format_R),
+        MakeInfo("remu", RV32M_REMU, Handler_REMU, Format_R),
+    };
 
-    uint32_t UImmediateI(uint32_t);
+    static_assert(std::size(Instructions) == Handler_LA);
+    static_assert([]
+    {
+        for (size_t i = 0; i < std::size(Instructions); ++i)
+            if (Instructions[i].Id != i)
+                return false;
+        return true;
+    }());
+
+    /**
+     * The handler of an instruction word, or Handler_Invalid. Two table lookups: opcode picks a
+     * row, funct3 and the bits that tell funct7 and imm variants apart pick the entry.
+     */
+    Handler Identify(uint32_t data);
+    const InstructionInfo* FindInstruction(uint32_t key);
 
     const char* RegisterName(uint32_t);
     const char* RegisterName(Register);
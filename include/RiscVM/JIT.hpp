@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <RiscVM/Block.hpp>
+#include <RiscVM/Op.hpp>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define RISCVM_HAS_JIT 1
+#else
+#define RISCVM_HAS_JIT 0
+#endif
+
+namespace RiscVM
+{
+    enum JitExit : uint32_t
+    {
+        JitExit_Jump,
+        JitExit_Store,
+        JitExit_Interpret,
+        JitExit_Budget,
+    };
+
+    /**
+     * One slot of the direct-mapped table compiled code consults for indirect jumps.
+     */
+    struct JitEntry
+    {
+        uint32_t PC;
+        uint8_t* Code;
+    };
+
+    /**
+     * State shared between the dispatcher and compiled code. Compiled code reaches it through a
+     * pinned host register; the dispatcher fills the inputs before entering and reads the exit
+     * fields afterwards. LinkSite is the jump to patch once the next block is compiled, or null
+     * when the exit was indirect. Every block checks Instructions against Budget on entry and
+     * leaves with JitExit_Budget once it is reached.
+     */
+    struct JitContext
+    {
+        int32_t* Registers;
+        char* Memory;
+        const Op* Ops;
+        JitEntry* Table;
+
+        uint64_t Instructions;
+        uint64_t Budget;
+        uint32_t Exit;
+        uint32_t Address;
+        uint32_t StoreSize;
+        uint8_t* LinkSite;
+    };
+
+    /**
+     * A bounded x86-64 code cache for hot blocks. Pages are either writable or executable, never
+     * both; every compile or patch flips the mapping for its duration. When the cache is full it
+     * is flushed as a whole and blocks recompile as they get hot again.
+     */
+    class JIT
+    {
+    public:
+        static constexpr size_t DefaultCapacity = 16 << 20;
+        static constexpr uint32_t TableBits = 12;
+        static constexpr uint32_t Threshold = 16;
+
+        explicit JIT(size_t capacity = DefaultCapacity);
+        ~JIT();
+
+        JIT(const JIT&) = delete;
+        JIT& operator=(const JIT&) = delete;
+
+        bool Compile(Block& block);
+        uint32_t Enter(JitContext& context, const uint8_t* code) const;
+
+        void Link(uint8_t* site, Block& target);
+        void Publish(uint32_t pc, const Block& block);
+        void Forget(Block& block);
+        void Flush();
+
+        JitEntry* Table();
+
+    private:
+        struct Patch
+        {
+            uint8_t* Site;
+            uint8_t* Stub;
+        };
+
+        void Writable() const;
+        void Executable() const;
+        void Reset();
+
+        uint8_t* m_Base = nullptr;
+        size_t m_Capacity = 0;
+        size_t m_Reserved = 0;
+        size_t m_Used = 0;
+
+        uint8_t* m_EnterCode = nullptr;
+        uint8_t* m_ExitCode = nullptr;
+        uint8_t* m_IndirectExitCode = nullptr;
+        uint8_t* m_BudgetExitCode = nullptr;
+
+        std::vector<JitEntry> m_Table;
+        std::unordered_map<Block*, std::vector<Patch>> m_Incoming;
+    };
+}
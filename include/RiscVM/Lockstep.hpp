@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <RiscVM/Op.hpp>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * Runs one program on Lanes guests at once, e.g. a parameter sweep. Registers live in
+     * structure-of-arrays form, one row of Lanes values per register, and each step executes one
+     * decoded op for every lane parked at the same pc, with the others masked out. The group is
+     * always the lanes at the lowest pc, so lanes that took different sides of a branch run apart
+     * and regroup as soon as they reach the same instruction again.
+     *
+     * The ALU kernels are fixed-width loops over a register row that the compiler turns into
+     * vector code for whatever the build targets (SSE2 by default, AVX2 or AVX-512 with -mavx2
+     * or -march=native). Loads, stores and ecalls go lane by lane.
+     *
+     * Each lane keeps its own memory and ecall context in a VM of its own. The program is decoded
+     * once from the loaded image, so stores into code are not seen.
+     */
+    class Lockstep
+    {
+    public:
+        static constexpr uint32_t Lanes = 8;
+
+        explicit Lockstep(const ECallTable& ecall_map = {});
+
+        void Load(const char* pgm, size_t len);
+        /**
+         * Every lane restarts at pc 0 with zeroed registers and a fresh copy of the image.
+         */
+        void Reset();
+
+        /**
+         * Steps until every lane has stopped (Stop_Exit) or max_steps steps have run (Stop_Budget).
+         * One step retires one instruction in each lane of the current group. A lane that retires
+         * EBREAK or whose ecall handler calls Yield() pauses past that instruction, and Run()
+         * returns Stop_Breakpoint or Stop_Yield right after that step, as VM::Run() would; the
+         * next Run() resumes the paused lanes.
+         */
+        StopReason Run(uint64_t max_steps = std::numeric_limits<uint64_t>::max());
+
+        /**
+         * Guest register r of a lane. R(lane, 0) reads as zero and swallows writes.
+         */
+        int32_t& R(uint32_t lane, uint32_t r);
+        uint32_t& PC(uint32_t lane);
+        VM& Lane(uint32_t lane);
+
+        [[nodiscard]] StopReason Reason(uint32_t lane) const;
+        [[nodiscard]] int32_t Status(uint32_t lane) const;
+        [[nodiscard]] uint64_t Instructions(uint32_t lane) const;
+        /**
+         * Steps taken so far. Instructions summed over the lanes divided by this is how many
+         * lanes were busy per step on average.
+         */
+        [[nodiscard]] uint64_t Steps() const;
+
+    private:
+        [[nodiscard]] bool Runnable(uint32_t pc) const;
+        void Sync();
+        void Regroup();
+        void Follow();
+        void Advance();
+        void Stop(uint32_t lane, StopReason reason);
+        void Exec(const Op& op);
+
+        alignas(64) int32_t m_Registers[RegisterSink + 1][Lanes]{};
+        alignas(64) uint32_t m_PC[Lanes]{};
+        // -1 for the lanes of the current group, 0 for the others. while a group runs, the m_PC and
+        // m_Instructions of its lanes lag behind m_GroupPC and m_Run; Sync() catches them up
+        alignas(64) int32_t m_Mask[Lanes]{};
+
+        bool m_Live[Lanes]{};
+        StopReason m_Stop[Lanes]{};
+        uint64_t m_Instructions[Lanes]{};
+        std::unique_ptr<VM> m_Lanes[Lanes];
+
+        std::vector<char> m_Image;
+        std::vector<Op> m_Ops;
+        uint32_t m_GroupPC = 0;
+        // lowest pc of a live lane outside the group, the maximum if every live lane is in it
+        uint32_t m_NextPC = 0;
+        uint32_t m_Lead = 0;
+        uint64_t m_Run = 0;
+        uint64_t m_Steps = 0;
+        // why a lane paused during this Run(), Stop_Budget while none has
+        StopReason m_Pause = Stop_Budget;
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * Ecalls every hart of a Machine answers on top of the host's ECallMap().
+     *   ECall_HartId     a0 = mhartid
+     *   ECall_HartStart  start hart a0 at pc a1 with a1 = a2; a0 = 0, or -1 if it is busy
+     */
+    enum MachineECall
+    {
+        ECall_HartId = 121,
+        ECall_HartStart = 122,
+    };
+
+    /**
+     * One guest memory shared by a fixed set of harts, each a VM with its own registers, pc and
+     * decode cache running on its own host thread. A hart starts with a0 = mhartid and a1 = the
+     * start argument. There is no A extension: harts see each other's plain loads and stores with
+     * whatever ordering the host gives, and the ecall handlers run on the calling hart's thread.
+     * An exception out of a handler stops its hart with Stop_Fault.
+     */
+    class Machine
+    {
+    public:
+        explicit Machine(uint32_t harts);
+        ~Machine();
+
+        Machine(const Machine&) = delete;
+        Machine& operator=(const Machine&) = delete;
+
+        /**
+         * Copies the image into a shared guest memory of max(len, memory_size) bytes.
+         */
+        void Load(const char* pgm, size_t len, size_t memory_size = 0);
+
+        /**
+         * Starts a stopped hart at pc on a thread of its own. False if the hart is still running.
+         */
+        bool Start(uint32_t hart, uint32_t pc, int32_t arg = 0);
+        /**
+         * Blocks until every hart has stopped, including harts started while waiting.
+         */
+        void Wait();
+        /**
+         * Starts hart 0 at pc 0, waits for all harts and returns the status of hart 0.
+         */
+        int32_t Run();
+
+        [[nodiscard]] uint32_t Harts() const;
+        [[nodiscard]] uint64_t Instructions() const;
+        [[nodiscard]] char* Memory() const;
+        [[nodiscard]] size_t MemorySize() const;
+
+        VM& Hart(uint32_t hart);
+        Engine& ActiveEngine();
+        ECallTable& ECallMap();
+
+    private:
+        struct Slot
+        {
+            std::unique_ptr<VM> Hart;
+            std::thread Thread;
+            std::atomic<bool> Running{false};
+        };
+
+        void Exec(Slot& slot);
+
+        std::unique_ptr<char[]> m_Memory;
+        size_t m_MemorySize = 0;
+        std::vector<Slot> m_Slots;
+        std::mutex m_Mutex;
+
+        Engine m_Engine = Engine_Threaded;
+        ECallTable m_ECallMap;
+    };
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace RiscVM
+{
+    enum Handler : uint8_t
+    {
+        Handler_Invalid,
+
+        Handler_LUI,
+        Handler_AUIPC,
+        Handler_JAL,
+        Handler_JALR,
+        Handler_BEQ,
+        Handler_BNE,
+        Handler_BLT,
+        Handler_BGE,
+        Handler_BLTU,
+        Handler_BGEU,
+        Handler_LB,
+        Handler_LH,
+        Handler_LW,
+        Handler_LBU,
+        Handler_LHU,
+        Handler_SB,
+        Handler_SH,
+        Handler_SW,
+        Handler_ADDI,
+        Handler_SLTI,
+        Handler_SLTIU,
+        Handler_XORI,
+        Handler_ORI,
+        Handler_ANDI,
+        Handler_SLLI,
+        Handler_SRLI,
+        Handler_SRAI,
+        Handler_ADD,
+        Handler_SUB,
+        Handler_SLL,
+        Handler_SLT,
+        Handler_SLTU,
+        Handler_XOR,
+        Handler_SRL,
+        Handler_SRA,
+        Handler_OR,
+        Handler_AND,
+        Handler_FENCE,
+        Handler_ECALL,
+        Handler_EBREAK,
+
+        Handler_MUL,
+        Handler_MULH,
+        Handler_MULHSU,
+        Handler_MULHU,
+        Handler_DIV,
+        Handler_DIVU,
+        Handler_REM,
+        Handler_REMU,
+
+        // superinstructions for the assembler's pseudo-op expansions, see Fuse()
+        Handler_LA,
+        Handler_LI,
+        Handler_CALL,
+        Handler_PUSH,
+        Handler_POP,
+
+        Handler_Count,
+    };
+
+    /**
+     * The register slot past x31. Decoded ops name it as Rd instead of x0, so writes to x0 land in
+     * a slot nobody reads and x0 itself stays zero without a check.
+     */
+    constexpr uint8_t RegisterSink = 32;
+
+    /**
+     * A predecoded instruction. Shift amounts live in Imm, store and branch operands in Rs1/Rs2.
+     * A destination of x0 is stored as RegisterSink.
+     * Handler_Invalid doubles as the "not yet decoded" marker, so a zeroed slot decodes on first use.
+     */
+    struct Op
+    {
+        uint8_t Handler;
+        uint8_t Rd;
+        uint8_t Rs1;
+        uint8_t Rs2;
+        int32_t Imm;
+    };
+
+    Op Decode(uint32_t);
+
+    /**
+     * Rewrites the head of every fusable run in ops[0, count) into a superinstruction. Only the head
+     * changes: it keeps the fields of its first instruction and reads the rest from the slots that
+     * follow it, which stay untouched so jumps into the middle of a run still find plain ops.
+     *   LA    auipc rd + addi rd,rd
+     *   LI    lui rd + addi rd,rd
+     *   CALL  auipc rd + jalr _,_(rd)
+     *   PUSH  addi rd,rd + Rs2 stores of sw _,_(rd)
+     *   POP   addi rd,rd + Rs2 loads of lw _,_(rd)
+     */
+    void Fuse(Op* ops, size_t count);
+
+    /**
+     * The handler of the first instruction of a superinstruction, or the handler itself.
+     */
+    constexpr Handler Unfuse(const Handler handler)
+    {
+        switch (handler)
+        {
+        case Handler_LA:
+        case Handler_CALL:
+            return Handler_AUIPC;
+        case Handler_LI:
+            return Handler_LUI;
+        case Handler_PUSH:
+        case Handler_POP:
+            return Handler_ADDI;
+        default:
+            return handler;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include <RiscVM/RiscVM.hpp>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * Counts how often each guest pc retires and how often each basic block is entered. A block
+     * starts wherever control did not fall through from the previous instruction, and after every
+     * jump, branch (taken or not) and ecall. Attach it as the tracer of a VM; the counters are plain
+     * arrays indexed by pc, so one profiler must not be shared by VMs running at the same time.
+     */
+    class Profiler : public Tracer
+    {
+    public:
+        void Retire(VM& vm, uint32_t pc, const Op& op) override;
+
+        void Clear();
+        /**
+         * Prints the top rows of three tables sorted by hotness: instructions per label, block
+         * entries and retirements per pc. Addresses are named through symbols.
+         */
+        void Report(std::ostream& stream, const SymbolMap& symbols = {}, size_t top = 20) const;
+
+        [[nodiscard]] uint64_t Count(uint32_t pc) const;
+        [[nodiscard]] uint64_t Entries(uint32_t pc) const;
+        [[nodiscard]] uint64_t Instructions() const;
+
+    private:
+        void Grow(uint32_t index);
+
+        // per word of guest code, grown to the highest pc seen
+        std::vector<uint64_t> m_Counts;
+        std::vector<uint64_t> m_Entries;
+        // the pc that continues the current block; anything else starts a new one
+        uint32_t m_Next = ~0u;
+    };
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <iosfwd>
+#include <map>
 #include <memory>
+#include <string>
 
 namespace RiscVM
 {
@@ -16,6 +20,26 @@ namespace RiscVM
 
     typedef std::shared_ptr<Operand> OperandPtr;
 
+    /**
+     * Label addresses of an assembled program. Local labels are named after the label they belong
+     * to, e.g. "fib.loop".
+     */
+    typedef std::map<uint32_t, std::string> SymbolMap;
+
     void DumpRaw(const char*, size_t);
     void Dump(const char*, size_t);
+    /**
+     * One instruction word as Dump() prints it, without the word itself.
+     */
+    std::string Disassemble(uint32_t);
+
+    /**
+     * Symbol files are text, one "address name" line per label with the address in hex.
+     */
+    void WriteSymbols(std::ostream&, const SymbolMap&);
+    SymbolMap ReadSymbols(std::istream&);
+    /**
+     * The nearest label at or below address, plus the distance to it, e.g. "fib+0x8".
+     */
+    std::string Symbolize(const SymbolMap&, uint32_t address);
 }
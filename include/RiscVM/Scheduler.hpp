@@ -0,0 +1,253 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * What an asynchronous ecall handler returns: a coroutine that may co_await an Event, or a
+     * Pipe through one, before it finishes the ecall. It starts when the ecall retires and
+     * completes it whenever it returns, writing a0 and guest memory like any handler. See
+     * Scheduler::Async().
+     */
+    class ECallTask
+    {
+    public:
+        struct promise_type
+        {
+            std::function<void(std::exception_ptr error)> OnDone;
+            std::exception_ptr Error;
+
+            ECallTask get_return_object()
+            {
+                return ECallTask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            auto final_suspend() noexcept
+            {
+                // the frame goes before whoever waits for it hears it is done, so the waiter may
+                // move on right away
+                struct Final
+                {
+                    bool await_ready() noexcept { return false; }
+
+                    void await_suspend(const std::coroutine_handle<promise_type> handle) noexcept
+                    {
+                        auto done = std::move(handle.promise().OnDone);
+                        const auto error = handle.promise().Error;
+                        handle.destroy();
+                        if (done)
+                            done(error);
+                    }
+
+                    void await_resume() noexcept {}
+                };
+                return Final{};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception()
+            {
+                Error = std::current_exception();
+            }
+        };
+
+        ECallTask(ECallTask&& other) noexcept;
+        ~ECallTask();
+
+        ECallTask(const ECallTask&) = delete;
+        ECallTask& operator=(const ECallTask&) = delete;
+
+    private:
+        friend class Scheduler;
+
+        explicit ECallTask(std::coroutine_handle<promise_type> handle);
+
+        std::coroutine_handle<promise_type> m_Handle;
+    };
+
+    class Event;
+
+    /**
+     * Runs many guests on a few host threads. Every spawned VM is a task that a worker runs for
+     * a quantum of instructions at a time and then sends to the back of a shared run queue, so
+     * CPU-bound guests take turns. A guest whose asynchronous ecall handler suspends is parked
+     * without holding a thread, and its worker moves on; whoever sets the Event the handler
+     * waits on queues the guest again, and the worker that picks it up resumes the handler
+     * before the guest runs on. Thousands of interactive guests thus share a handful of threads.
+     *
+     * Guests must not share memory; each is only ever run by one worker at a time, but not
+     * always the same one. An exception out of an ecall handler stops its guest with
+     * Stop_Fault.
+     */
+    class Scheduler
+    {
+    public:
+        typedef std::function<ECallTask(VM& vm)> AsyncECall;
+
+        struct Guest;
+
+        /**
+         * threads of 0 runs one per hardware thread.
+         */
+        explicit Scheduler(uint32_t threads = 0, uint64_t quantum = 1000000);
+        /**
+         * Waits for every guest to stop, then stops the workers.
+         */
+        ~Scheduler();
+
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        /**
+         * Queues a loaded and reset vm, which must outlive the run. The returned pipe is what the
+         * ecalls of Install() read for this guest.
+         */
+        class Pipe& Spawn(VM& vm);
+        /**
+         * Blocks until every guest spawned so far has stopped with Stop_Exit, Stop_Fault or
+         * Stop_Fuel.
+         */
+        void Wait();
+        [[nodiscard]] uint32_t Threads() const;
+
+        /**
+         * Installs handler for number. Run by a Scheduler, a handler that suspends parks the guest
+         * until it finishes; run anywhere else, the ecall blocks its thread until then.
+         */
+        static void Async(ECallTable& ecall_map, int number, AsyncECall handler);
+        /**
+         * getc (3) and fgets (4) of the console as asynchronous ecalls that wait for the guest's
+         * Pipe instead of a host thread. Outside a Scheduler they read VM::IO() as usual.
+         */
+        static void Install(ECallTable& ecall_map);
+        /**
+         * The pipe of the guest running on the calling thread, nullptr outside a Scheduler.
+         */
+        static Pipe* Input();
+
+    private:
+        friend class Event;
+
+        static void Start(VM& vm, ECallTask task);
+        static void Ready(Guest* guest, std::coroutine_handle<> handle);
+        void Loop();
+        void Enqueue(Guest* guest);
+
+        std::vector<std::thread> m_Threads;
+        uint64_t m_Quantum;
+
+        std::vector<std::unique_ptr<Guest>> m_Guests;
+        std::deque<Guest*> m_Queue;
+        size_t m_Live = 0;
+        bool m_Quit = false;
+
+        std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        std::condition_variable m_Idle;
+    };
+
+    /**
+     * A flag that coroutines can co_await. Set() releases every waiter: one that suspended in a
+     * guest's ecall is resumed by the worker that next runs the guest, any other right away on
+     * the setting thread.
+     */
+    class Event
+    {
+    public:
+        void Set();
+        void Reset();
+        [[nodiscard]] bool IsSet() const;
+
+        auto operator co_await()
+        {
+            struct Awaiter
+            {
+                Event& Target;
+
+                bool await_ready() const
+                {
+                    return Target.IsSet();
+                }
+
+                bool await_suspend(const std::coroutine_handle<> handle)
+                {
+                    return Target.Wait(handle);
+                }
+
+                void await_resume() const {}
+            };
+            return Awaiter{*this};
+        }
+
+    private:
+        struct Waiter
+        {
+            std::coroutine_handle<> Handle;
+            Scheduler::Guest* Guest;
+        };
+
+        bool Wait(std::coroutine_handle<> handle);
+
+        mutable std::mutex m_Mutex;
+        bool m_Set = false;
+        std::vector<Waiter> m_Waiters;
+    };
+
+    /**
+     * Console input of a guest run by a Scheduler. The host writes into it from any thread;
+     * Get() and GetLine() never block and return Empty when the guest has to co_await
+     * Readable() first.
+     */
+    class Pipe
+    {
+    public:
+        static constexpr int Empty = -2;
+
+        void Write(std::string_view data);
+        /**
+         * The end of the input: reads return what is left, then -1.
+         */
+        void Close();
+
+        /**
+         * Set while there is input or the pipe is closed.
+         */
+        Event& Readable();
+
+        /**
+         * The next character as an unsigned char, -1 after Close().
+         */
+        int Get();
+        /**
+         * fgets() once a whole line, size - 1 characters or the end of the input are there:
+         * 1 for a line, -1 after Close() with nothing left.
+         */
+        int GetLine(char* buffer, size_t size);
+
+    private:
+        std::mutex m_Mutex;
+        std::string m_Data;
+        size_t m_Begin = 0;
+        bool m_Closed = false;
+        Event m_Readable;
+    };
+}
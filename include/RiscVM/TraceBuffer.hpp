@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * Flight recorder for post-mortem debugging: keeps the last Capacity() retired instructions
+     * of one VM in a fixed ring, overwriting the oldest. The threaded engine recognizes it as its
+     * tracer and inlines Append() instead of calling Retire(), which costs a few stores into a
+     * preallocated slot and one release store of the head per instruction, with no locks and no
+     * allocation. It still keeps the guest well below full speed, so it is a debugging tool, not
+     * something to leave on.
+     *
+     * The ring holds no instruction words. Write() reads them back from the memory of the VM
+     * that last recorded, which must still be alive, and the engine only logs the old words of a
+     * code page the guest stores into. Records older than a host write to code, through Memory()
+     * or an ecall handler, show the words it wrote. Another thread may Write() the ring while
+     * the guest runs; records that are overwritten during the copy come out torn.
+     *
+     * Write() delta-encodes the ring into a compact stream, mostly a byte or two per
+     * instruction, and Read() and Print() turn it back into Dump()-style text.
+     */
+    class TraceBuffer final : public Tracer
+    {
+    public:
+        struct Record
+        {
+            uint32_t PC;
+            uint32_t Word;
+            // rd after the instruction, if it writes one
+            uint32_t Value;
+            // the effective address of a load or store
+            uint32_t Address;
+        };
+
+        /**
+         * capacity is rounded up to a power of two.
+         */
+        explicit TraceBuffer(size_t capacity = size_t{1} << 22);
+
+        /**
+         * For tracers that forward to this one: recovers the address of a load or store from a
+         * copy of the registers it keeps in step, and does not see the guest store into code.
+         */
+        void Retire(VM& vm, uint32_t pc, const Op& op) override;
+        /**
+         * Records the instruction at pc, which just retired as op, given the register file
+         * afterwards and the effective address of a load or store, anything for other ops.
+         */
+        void Append(const int32_t* x, uint32_t pc, const Op& op, uint32_t address)
+        {
+            const auto head = m_Head.load(std::memory_order_relaxed);
+            auto& slot = m_Ring[head & m_Mask];
+            slot.PC = pc;
+            slot.Value = x[op.Rd];
+            slot.Address = address;
+            m_Head.store(head + 1, std::memory_order_release);
+        }
+
+        void Clear();
+        [[nodiscard]] size_t Capacity() const;
+        /**
+         * Instructions recorded since construction or Clear(), including those already
+         * overwritten.
+         */
+        [[nodiscard]] uint64_t Retired() const;
+
+        void Write(std::ostream& stream) const;
+        /**
+         * The records of a stream made by Write(), oldest first. Throws std::runtime_error on
+         * anything else.
+         */
+        static std::vector<Record> Read(std::istream& stream);
+        /**
+         * One line per record: pc, word and disassembly as Dump() prints them, then the register
+         * written and the memory address accessed.
+         */
+        static void Print(std::ostream& stream, const std::vector<Record>& records);
+
+    private:
+        friend class VM;
+
+        // a record without its word, which Write() recovers
+        struct Slot
+        {
+            uint32_t PC;
+            uint32_t Value;
+            uint32_t Address;
+        };
+
+        // the word at Address before the instruction numbered Head stored into its page
+        struct Change
+        {
+            uint64_t Head;
+            uint32_t Address;
+            uint32_t Word;
+        };
+
+        /**
+         * Called by the threaded engine before a store of size bytes at address hits decoded
+         * code: logs every decoded word of the pages it touches, since invalidating a page
+         * drops all of them.
+         */
+        void Overwrite(const char* memory, const Op* ops, size_t op_count, uint32_t address, uint32_t size);
+
+        std::unique_ptr<Slot[]> m_Ring;
+        size_t m_Mask;
+        std::atomic<uint64_t> m_Head{0};
+        const VM* m_VM = nullptr;
+
+        mutable std::mutex m_Mutex;
+        std::vector<Change> m_Changes;
+        size_t m_Prune = 4096;
+
+        // registers as of the last instruction passed to Retire(). a load that overwrites its
+        // own base register finds the base here
+        int32_t m_Shadow[RegisterSink + 1]{};
+        bool m_Synced = false;
+    };
+}
@@ -2,31 +2,314 @@
 
 #include <cstdint>
 #include <functional>
-#include <map>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <RiscVM/Block.hpp>
+#include <RiscVM/Console.hpp>
+#include <RiscVM/ECallTable.hpp>
+#include <RiscVM/JIT.hpp>
+#include <RiscVM/Op.hpp>
 
 namespace RiscVM
 {
-    typedef std::function<void(class VM& vm)> ECall;
+    enum Engine
+    {
+        Engine_Switch,
+        Engine_Threaded,
+        Engine_Block,
+        Engine_JIT,
+    };
+
+    /**
+     * What the threaded engine verifies before every load and store. A failed check stops the
+     * guest with Stop_Fault and leaves PC() on the access.
+     */
+    enum Check
+    {
+        Check_None, // the address is trusted, as on real hardware without an MMU
+        Check_Bounds, // the whole access lies inside guest memory
+        Check_Alignment, // Check_Bounds, and the address is a multiple of the access size
+    };
+
+    /**
+     * Instruction set the threaded engine accepts. Ops outside it fault like an undecodable word.
+     */
+    enum Subset
+    {
+        Subset_RV32I,
+        Subset_RV32IM,
+    };
+
+    /**
+     * Instrumentation hook of the threaded engine, called after every retired instruction with
+     * its pc and decoded op. Registers already hold the result; PC() and Instructions() are only
+     * brought up to date at ecalls and stops.
+     */
+    class Tracer
+    {
+    public:
+        virtual ~Tracer() = default;
+        virtual void Retire(VM& vm, uint32_t pc, const Op& op) = 0;
+    };
+
+    /**
+     * Why Run() or RunUntil() handed control back to the host.
+     */
+    enum StopReason
+    {
+        Stop_Exit, // Ok() was cleared, usually by the exit ecall
+        Stop_Yield, // an ecall handler called Yield(); the pc is past the ecall
+        Stop_Breakpoint, // EBREAK retired or RunUntil() reached its pc
+        Stop_Fault, // the pc left guest memory, was misaligned or hit an undecodable word, or an ecall faulted
+        Stop_Budget, // the instruction budget of this Run() ran out
+        Stop_Fuel, // the VM's fuel ran out; every Run() returns this until Fuel() is refilled
+    };
 
     class VM
     {
     public:
+        VM() = default;
+        ~VM();
+
+        VM(const VM&) = delete;
+        VM& operator=(const VM&) = delete;
+
         void Reset();
-        void Load(const char* pgm, size_t len);
+        /**
+         * Copies the image to address 0 of a guest memory of max(len, memory_size) bytes. On Linux
+         * a memory of at least ReserveThreshold bytes is reserved address space that the host backs
+         * with zero pages until first written, so the untouched parts, zero runs of the image
+         * included, take no RAM and a large address space is cheap. The engines keep indexing it
+         * flat; the host MMU is the page table.
+         */
+        void Load(const char* pgm, size_t len, size_t memory_size = 0);
+        /**
+         * Load() for a raw image on disk. On Linux a regular file is mapped private
+         * copy-on-write straight into guest memory, with zero pages past its end, so the image is
+         * never copied and startup costs a page fault per page the guest touches. Other files,
+         * pipes included, are read and loaded. False if the file cannot be opened.
+         */
+        bool LoadFile(const std::string& path, size_t memory_size = 0);
+        /**
+         * Set before Load() to place guest memory in a 4 GiB window of inaccessible pages that
+         * covers every address a load or store can form from a register and an immediate. An
+         * access outside guest memory then raises SIGSEGV, which Run() turns into Stop_Fault, and
+         * loads and stores stay a single host instruction. The check has host page granularity:
+         * the tail of the last page past MemorySize() stays accessible. After a fault only the
+         * switch engine leaves PC() on the faulting instruction. Ecall handlers run outside the
+         * guard, so one that follows a bad guest pointer crashes the host as usual and has to
+         * check its arguments, see Bind.hpp. Linux only; Guarded() tells whether the loaded
+         * memory got its guard.
+         */
+        bool& GuardPages();
+        [[nodiscard]] bool Guarded() const;
+        /**
+         * Set before Load() or LoadFile() to keep the image and log which pages of guest memory
+         * are written from then on, so ResetToImage() only restores those. On Linux the memory is
+         * write-protected and the SIGSEGV handler logs the first write to each host page and lets
+         * it through, so the engines run unchanged and a written page costs one fault per reset.
+         * Elsewhere, and for memory that is not mapped, ResetToImage() compares every page.
+         */
+        bool& DirtyTracking();
+        /**
+         * Host pages logged as written since the load or the last ResetToImage(), 0 while
+         * writes are not tracked.
+         */
+        [[nodiscard]] size_t DirtyPages() const;
+        /**
+         * Those pages by index, see DirtyPageSize().
+         */
+        [[nodiscard]] std::span<const uint32_t> DirtyLog() const;
+        /**
+         * The size of a host page, 0 while writes are not tracked.
+         */
+        [[nodiscard]] size_t DirtyPageSize() const;
+        /**
+         * Puts guest memory back to the image of the last load and the VM back to a fresh start:
+         * pc, registers and status zero, the guest running again, and the console's buffered
+         * input and pending output dropped. Code on pages the guest did not write stays decoded.
+         * False, changing nothing, unless the image was loaded with DirtyTracking() on.
+         */
+        bool ResetToImage();
+        /**
+         * Tells which bytes a stretch of host code writes, on memory whose writes are tracked:
+         * until Unwatch() the SIGSEGV handler saves each write-protected page before the first
+         * write to it goes through, and Unwatch() then calls written once per page written in
+         * between, in address order, with what the page held before. Pages in DirtyLog() are
+         * writable and go unseen unless written is set, which write-protects them again at the
+         * cost of a fault on their next write from either side; a caller that keeps copies of a
+         * few can compare those instead. False, watching nothing, while writes are not tracked.
+         * See ECallLog.
+         */
+        bool Watch(bool written = true);
+        void Unwatch(const std::function<void(uint32_t address, const char* before, size_t size)>& written);
+        /**
+         * Runs on guest memory owned by someone else, e.g. the Machine all harts share. The VM
+         * keeps a private decode cache over it, so stores by other harts into code this hart has
+         * already decoded are not seen. Load() detaches again.
+         */
+        void Attach(char* memory, size_t size);
+        /**
+         * A child that continues from the current state: registers, pc, status, engine, checks,
+         * subset, ecall table and the console's sink, source and flush policy are copied; the
+         * tracer is not, as children run in parallel and would race on it. Guest memory and the
+         * decode cache are shared copy-on-write. On Linux the first fork writes both into a memfd
+         * snapshot that parent and children then map privately, and further forks reuse it until
+         * the parent runs again or Memory() hands out guest memory to the host, so they cost two
+         * mmaps rather than a copy. Elsewhere, and for attached memory, forks copy.
+         */
+        [[nodiscard]] std::unique_ptr<VM> Fork();
         bool Cycle();
 
+        /**
+         * Runs the active engine until the guest stops or has retired max_instructions more
+         * instructions. The switch engine stops exactly on budget; the others check it at
+         * control transfers and may finish the straight-line run they are in.
+         */
+        StopReason Run(uint64_t max_instructions = std::numeric_limits<uint64_t>::max());
+        /**
+         * Runs at least one instruction and stops before executing the one at pc. Whatever the
+         * active engine, it runs an instance of the threaded engine that checks the pc and the
+         * budget after every instruction and does not fuse superinstructions, so both stops are
+         * exact and the policies below apply as in Run().
+         */
+        StopReason RunUntil(uint32_t pc, uint64_t max_instructions = std::numeric_limits<uint64_t>::max());
+        /**
+         * Called from an ecall handler: the current Run() returns Stop_Yield after the ecall.
+         */
+        void Yield();
+        /**
+         * Called from an ecall handler: stops the guest with Stop_Fault, e.g. for a guest pointer
+         * that does not lie in guest memory. Always false.
+         */
+        bool Fault();
+
         [[nodiscard]] char* Memory() const;
         [[nodiscard]] size_t MemorySize() const;
+        [[nodiscard]] uint64_t Instructions() const;
+        /**
+         * Instructions the guest may still retire over all runs, unlimited by default. Each Run()
+         * caps its budget at the fuel and burns what it retired, so the engines meter it for
+         * free: they charge per block or jump, like the budget, and may overrun the fuel by the
+         * rest of a straight-line run, which leaves it at 0. A guest that has none left stops
+         * with Stop_Fuel, which lets a host kill runaway guests, while Stop_Budget only preempts.
+         */
+        uint64_t& Fuel();
 
         bool& Ok();
         int32_t& Status();
+        int32_t& PC();
+        uint32_t& HartId();
+        Engine& ActiveEngine();
+        /**
+         * Policies of the threaded engine. Every combination is a separately compiled instance
+         * of it with the checks and the hook inlined into the handlers, so the default of no
+         * checks, RV32IM and no tracer pays for none of them. While any of them differs from the
+         * default, Run() uses the matching instance whatever the active engine; RunUntil()
+         * always does.
+         */
+        Check& Checking();
+        Subset& ISASubset();
+        Tracer*& ActiveTracer();
 
+        /**
+         * Host access to a guest register. R(0) reads as zero and swallows writes.
+         */
         int32_t& R(uint32_t);
 
-        std::map<int, ECall>& ECallMap();
+        /**
+         * Branch-free access to a register that is known not to be x0 at compile time.
+         */
+        template <uint32_t N>
+        int32_t& R()
+        {
+            static_assert(N != 0 && N < 32, "x0 is hardwired to zero");
+            return m_Registers[N];
+        }
+
+        /**
+         * The register file as the engines see it, x0 through x31 followed by RegisterSink, for
+         * tracers that read it after every instruction. Entry 0 is always zero; the sink is not.
+         */
+        [[nodiscard]] const int32_t* Registers() const
+        {
+            return m_Registers;
+        }
+
+        ECallTable& ECallMap();
+        /**
+         * The console device of this VM, created on first use on the host's stdout and stdin.
+         * Its pending output is flushed whenever the guest stops.
+         */
+        Console& IO();
+
+        static constexpr uint32_t PageBits = 12;
+        static constexpr uint32_t PageSize = 1 << PageBits;
+        static constexpr size_t ReserveThreshold = 256 * 1024;
 
     private:
-        void Exec(uint32_t data);
+        // runs ecalls on its lanes' VMs itself and has to see a Yield()
+        friend class Lockstep;
+
+        // who owns m_Memory and m_Ops, and so how Release() hands them back
+        enum Backing
+        {
+            Backing_Heap, // both malloc'd
+            Backing_Reserved, // anonymous mappings, see Load()
+            Backing_Snapshot, // private mappings of a fork snapshot
+            Backing_File, // the image file mapped privately over anonymous memory, see LoadFile()
+            Backing_Attached, // memory belongs to someone else, m_Ops is malloc'd
+        };
+
+        // how the threaded engine reaches m_Tracer: a TraceBuffer is recorded into inline, any
+        // other tracer through its virtual Retire()
+        enum Hook
+        {
+            Hook_None,
+            Hook_Tracer,
+            Hook_TraceBuffer,
+        };
+
+        static bool IsZero(const char* data, size_t size);
+
+        bool Begin(uint64_t max_instructions);
+        StopReason Finish();
+        void Protect(const std::function<void()>& body);
+        bool CallHost(int32_t number);
+        void AllocateOps();
+        void Release();
+        bool Reserve(size_t size);
+        bool MapFile(const std::string& path, size_t memory_size);
+        bool Snapshot();
+        bool Map(char*& memory, Op*& ops) const;
+        void DropSnapshot();
+        bool Track(const uint32_t* dirty = nullptr, size_t count = 0);
+        void Untrack();
+        void WriteProtect(const uint32_t* pages, size_t count) const;
+        void Restore(size_t begin, size_t end);
+
+        // operand access for the handlers: x0 is never written and decoded destinations already
+        // name RegisterSink instead of it, so no check is needed
+        int32_t& X(const uint32_t r) { return m_Registers[r]; }
+
+        void Exec(const Op& op);
+        void RunThreaded();
+        void RunThreaded(bool step, uint32_t until);
+        template <Check C, Subset S, Hook H, bool U>
+        void RunThreaded(uint32_t until);
+        void RunBlocks();
+        void RunJIT();
+        void DecodePage(uint32_t page);
+        void Invalidate(uint32_t addr);
+
+        Block* FindBlock(uint32_t pc);
+        void InvalidateBlocks(uint32_t page);
+        void FlushBlocks();
+        void CollectBlocks();
 
         void LUI(uint32_t rd, int32_t imm);
         void AUIPC(uint32_t rd, int32_t imm);
@@ -79,16 +362,62 @@ namespace RiscVM
         void REMU(uint32_t rd, uint32_t rs1, uint32_t rs2);
 
     private:
-        int32_t m_Registers[32]{};
+        int32_t m_Registers[RegisterSink + 1]{};
         int32_t m_PC = 0;
         int32_t m_Status = 0;
 
         char* m_Memory = nullptr;
         size_t m_MemorySize = 0;
+        Backing m_Backing = Backing_Heap;
+        bool m_GuardPages = false;
+        bool m_Guarded = false;
+        int m_Snapshot = -1;
+        // the instruction count the snapshot was taken at, ~0 once the host may have written
+        // memory behind it, see Memory()
+        mutable uint64_t m_SnapshotAt = 0;
+
+        // the loaded image and the log of written host pages, see DirtyTracking(). m_TrackSlot is
+        // where the SIGSEGV handler finds the log, -1 while writes are not tracked
+        bool m_DirtyTracking = false;
+        std::shared_ptr<const char[]> m_Image;
+        size_t m_ImageSize = 0;
+        int m_TrackSlot = -1;
+        std::unique_ptr<uint8_t[]> m_DirtyMap;
+        std::unique_ptr<uint32_t[]> m_DirtyLog;
+        size_t m_DirtyCount = 0;
+        size_t m_DirtyCapacity = 0;
+        // pages written while watched and their saved contents, allocated by the first Watch()
+        bool m_Watching = false;
+        std::unique_ptr<uint32_t[]> m_Watched;
+        char* m_Before = nullptr;
+        size_t m_WatchCount = 0;
+        uint32_t m_HartId = 0;
+
+        // one slot per word of guest memory plus a zeroed one past the end. plain memory so a
+        // snapshot can share it copy-on-write like guest memory
+        Op* m_Ops = nullptr;
+        size_t m_OpCount = 0;
+
+        std::unordered_map<uint32_t, std::unique_ptr<Block>> m_Blocks;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> m_PageBlocks;
+        std::vector<std::unique_ptr<Block>> m_RetiredBlocks;
+        std::unique_ptr<JIT> m_JIT;
+        uint64_t m_Instructions = 0;
+        uint64_t m_Deadline = 0;
+        uint64_t m_Fuel = std::numeric_limits<uint64_t>::max();
+        uint64_t m_Started = 0;
+
+        Engine m_Engine = Engine_Threaded;
+        Check m_Check = Check_None;
+        Subset m_Subset = Subset_RV32IM;
+        Tracer* m_Tracer = nullptr;
 
         bool m_DirtyPC = false;
         bool m_Ok = true;
+        bool m_Pause = false;
+        StopReason m_Stop = Stop_Exit;
 
-        std::map<int, ECall> m_ECallMap;
+        ECallTable m_ECallMap;
+        std::unique_ptr<Console> m_Console;
     };
 }
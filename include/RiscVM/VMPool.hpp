@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <RiscVM/VM.hpp>
+
+namespace RiscVM
+{
+    /**
+     * A loaded program, shared read-only by every job that runs it.
+     */
+    typedef std::shared_ptr<const std::vector<char>> Image;
+
+    struct Job
+    {
+        Image Program;
+        /**
+         * Copied into a0, a1, ... before the job starts; the other registers start at zero.
+         */
+        std::vector<int32_t> Args;
+        uint64_t MaxInstructions = std::numeric_limits<uint64_t>::max();
+        /**
+         * What the job's console reads; it sees the end of its input after that.
+         */
+        std::string Input;
+    };
+
+    struct JobResult
+    {
+        StopReason Reason = Stop_Exit;
+        int32_t Status = 0;
+        uint64_t Instructions = 0;
+        /**
+         * What the job wrote to its console, and whatever the ecall handlers appended through
+         * VMPool::Output() while the job ran.
+         */
+        std::string Output;
+    };
+
+    /**
+     * Runs many short, independent guest programs on a fixed set of worker threads. Each worker
+     * owns one VM for its whole life, so a job costs a memcpy of its image instead of an
+     * allocation, and the ecall table is copied once per worker rather than once per job. A
+     * worker that runs a large program again only restores the pages the last job wrote, see
+     * VM::ResetToImage(). Jobs are spread round-robin over per-worker queues; an idle worker
+     * takes from the front of its own queue and steals from the back of the others'. Each
+     * worker's console writes into the result of its job and reads the job's input, so jobs
+     * never touch the host's stdio.
+     */
+    class VMPool
+    {
+    public:
+        explicit VMPool(uint32_t workers, const ECallTable& ecall_map = {}, Engine engine = Engine_Threaded);
+        /**
+         * Finishes every job already submitted, then stops the workers.
+         */
+        ~VMPool();
+
+        VMPool(const VMPool&) = delete;
+        VMPool& operator=(const VMPool&) = delete;
+
+        static Image Share(const char* pgm, size_t len);
+
+        std::future<JobResult> Submit(Job job);
+        /**
+         * Blocks until every job submitted so far has finished.
+         */
+        void Wait();
+
+        [[nodiscard]] uint32_t Workers() const;
+
+        /**
+         * Output buffer of the job running on the calling thread. Only valid inside an ecall
+         * handler of a pooled job.
+         */
+        static std::string& Output();
+
+    private:
+        struct Task
+        {
+            Job Work;
+            std::promise<JobResult> Promise;
+        };
+
+        struct Worker
+        {
+            std::mutex Mutex;
+            std::deque<Task> Queue;
+            VM Hart;
+            Image Loaded;
+            std::thread Thread;
+        };
+
+        void Loop(uint32_t index);
+        bool Reserve();
+        Task Take(uint32_t index);
+        JobResult Exec(Worker& worker, const Job& job);
+
+        std::vector<std::unique_ptr<Worker>> m_Workers;
+        Engine m_Engine;
+
+        std::atomic<uint32_t> m_Next{0};
+        std::atomic<size_t> m_Pending{0};
+        std::atomic<size_t> m_Unfinished{0};
+
+        std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        std::condition_variable m_Idle;
+        bool m_Quit = false;
+    };
+}
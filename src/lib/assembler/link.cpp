@@ -5,6 +5,7 @@
 #include <RiscVM/ISA.hpp>
 #include <RiscVM/Operand.hpp>
 #include <RiscVM/Section.hpp>
+#include <RiscVM/Symbol.hpp>
 
 void RiscVM::Assembler::Link(LinkInfo& link_info, std::vector<char>& dest)
 {
@@ -24,6 +25,20 @@ void RiscVM::Assembler::Link(LinkInfo& link_info, std::vector<char>& dest)
 
     dest.resize(off);
 
+    // labels only; .set constants carry the Base 1 and undefined symbols none. global labels go
+    // first, so they name an address they share with a local one
+    const auto placed = [](const SymbolBase& symbol)
+    {
+        return symbol.Base && reinterpret_cast<intptr_t>(symbol.Base) != 1 && symbol.Base->Offset != static_cast<uint32_t>(-1);
+    };
+    for (const auto& [name_, symbol_] : m_SymbolTable)
+        if (placed(symbol_))
+            link_info.Symbols.emplace(symbol_.Base->Offset + symbol_.Offset, name_);
+    for (const auto& [name_, symbol_] : m_SymbolTable)
+        for (const auto& [sub_name_, sub_symbol_] : symbol_.SubSymbols)
+            if (placed(sub_symbol_))
+                link_info.Symbols.emplace(sub_symbol_.Base->Offset + sub_symbol_.Offset, name_ + sub_name_);
+
     for (auto& [l_name_, l_align_, l_size_, l_offset_] : link_info.Sections)
     {
         auto& [offset_, instructions_, data_] = m_Sections[l_name_];
@@ -32,172 +47,69 @@ void RiscVM::Assembler::Link(LinkInfo& link_info, std::vector<char>& dest)
         for (auto& [i_offset_, i_rv_, i_operands_] : instructions_)
         {
             const auto ptr = reinterpret_cast<uint32_t*>(dest.data() + offset_ + i_offset_);
-            const auto i = i_rv_;
-            switch (i_rv_)
+            const auto info = FindInstruction(i_rv_);
+            if (!info)
+                continue;
+
+            auto word = info->Match;
+            switch (info->Form)
             {
-            case RV32I_ADD:
-            case RV32I_SUB:
-            case RV32I_SLL:
-            case RV32I_SLT:
-            case RV32I_SLTU:
-            case RV32I_XOR:
-            case RV32I_SRL:
-            case RV32I_SRA:
-            case RV32I_OR:
-            case RV32I_AND:
-            case RV32M_MUL:
-            case RV32M_MULH:
-            case RV32M_MULHSU:
-            case RV32M_MULHU:
-            case RV32M_DIV:
-            case RV32M_DIVU:
-            case RV32M_REM:
-            case RV32M_REMU:
-                {
-                    const Format::R x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Rd = i_operands_[0]->AsRegister(),
-                        .Func3 = i >> 7 & 0b111,
-                        .Rs1 = i_operands_[1]->AsRegister(),
-                        .Rs2 = i_operands_[2]->AsRegister(),
-                        .Func7 = i >> 10 & 0b1111111,
-                    };
-                    *ptr = x.Data;
-                }
-                break; // R
+            case Format_R:
+                word |= EncodeRd(i_operands_[0]->AsRegister())
+                    | EncodeRs1(i_operands_[1]->AsRegister())
+                    | EncodeRs2(i_operands_[2]->AsRegister());
+                break;
 
-            case RV32I_JALR:
-                {
-                    const auto o = std::dynamic_pointer_cast<OffsetOperand>(i_operands_[1]);
-                    Format::I x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Rd = i_operands_[0]->AsRegister(),
-                        .Func3 = i >> 7 & 0b111,
-                        .Rs1 = o->Base->AsRegister(),
-                    };
-                    x.Immediate(o->Offset->AsImmediate());
-                    *ptr = x.Data;
-                }
-                break; // JALR
+            case Format_I:
+                word |= EncodeRd(i_operands_[0]->AsRegister())
+                    | EncodeRs1(i_operands_[1]->AsRegister())
+                    | EncodeI(i_operands_[2]->AsImmediate());
+                break;
 
-            case RV32I_ECALL:
-            case RV32I_EBREAK:
-                {
-                    const Format::I x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Func3 = i >> 7 & 0b111,
-                    };
-                    *ptr = x.Data;
-                }
-                break; // ENV
+            case Format_Shift:
+                word |= EncodeRd(i_operands_[0]->AsRegister())
+                    | EncodeRs1(i_operands_[1]->AsRegister())
+                    | EncodeRs2(static_cast<uint32_t>(i_operands_[2]->AsImmediate()));
+                break;
 
-            case RV32I_LB:
-            case RV32I_LH:
-            case RV32I_LW:
-            case RV32I_LBU:
-            case RV32I_LHU:
+            case Format_Load:
                 {
                     const auto o = std::dynamic_pointer_cast<OffsetOperand>(i_operands_[1]);
-                    Format::I x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Rd = i_operands_[0]->AsRegister(),
-                        .Func3 = i >> 7 & 0b111,
-                        .Rs1 = o->Base->AsRegister(),
-                    };
-                    x.Immediate(o->Offset->AsImmediate());
-                    *ptr = x.Data;
+                    word |= EncodeRd(i_operands_[0]->AsRegister())
+                        | EncodeRs1(o->Base->AsRegister())
+                        | EncodeI(o->Offset->AsImmediate());
                 }
-                break; // LOAD
+                break;
 
-            case RV32I_ADDI:
-            case RV32I_SLTI:
-            case RV32I_SLTIU:
-            case RV32I_XORI:
-            case RV32I_ORI:
-            case RV32I_ANDI:
-            case RV32I_SLLI:
-            case RV32I_SRLI:
-            case RV32I_SRAI:
-            case RV32I_FENCE:
-                {
-                    Format::I x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Rd = i_operands_[0]->AsRegister(),
-                        .Func3 = i >> 7 & 0b111,
-                        .Rs1 = i_operands_[1]->AsRegister(),
-                    };
-                    x.Immediate(i_operands_[2]->AsImmediate());
-                    *ptr = x.Data;
-                }
-                break; // I
-
-            case RV32I_SB:
-            case RV32I_SH:
-            case RV32I_SW:
+            case Format_S:
                 {
                     const auto o = std::dynamic_pointer_cast<OffsetOperand>(i_operands_[1]);
-                    Format::S x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Func3 = i >> 7 & 0b111,
-                        .Rs1 = i_operands_[0]->AsRegister(),
-                        .Rs2 = o->Base->AsRegister(),
-                    };
-                    x.Immediate(o->Offset->AsImmediate());
-                    *ptr = x.Data;
+                    word |= EncodeRs1(i_operands_[0]->AsRegister())
+                        | EncodeRs2(o->Base->AsRegister())
+                        | EncodeS(o->Offset->AsImmediate());
                 }
-                break; // S
+                break;
 
-            case RV32I_BEQ:
-            case RV32I_BNE:
-            case RV32I_BLT:
-            case RV32I_BGE:
-            case RV32I_BLTU:
-            case RV32I_BGEU:
-                {
-                    Format::B x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Func3 = i >> 7 & 0b111,
-                        .Rs1 = i_operands_[0]->AsRegister(),
-                        .Rs2 = i_operands_[1]->AsRegister(),
-                    };
-                    x.Immediate(i_operands_[2]->AsImmediate());
-                    *ptr = x.Data;
-                }
-                break; // B
+            case Format_B:
+                word |= EncodeRs1(i_operands_[0]->AsRegister())
+                    | EncodeRs2(i_operands_[1]->AsRegister())
+                    | EncodeB(i_operands_[2]->AsImmediate());
+                break;
 
-            case RV32I_LUI:
-            case RV32I_AUIPC:
-                {
-                    Format::U x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Rd = i_operands_[0]->AsRegister(),
-                    };
-                    x.Immediate(i_operands_[1]->AsImmediate() << 12);
-                    *ptr = x.Data;
-                }
-                break; // U
+            case Format_U:
+                word |= EncodeRd(i_operands_[0]->AsRegister())
+                    | EncodeU(i_operands_[1]->AsImmediate() << 12);
+                break;
 
-            case RV32I_JAL:
-                {
-                    Format::J x
-                    {
-                        .Opcode = i & 0b1111111,
-                        .Rd = i_operands_[0]->AsRegister(),
-                    };
-                    x.Immediate(i_operands_[1]->AsImmediate());
-                    *ptr = x.Data;
-                }
-                break; // J
-            default: break;
+            case Format_J:
+                word |= EncodeRd(i_operands_[0]->AsRegister())
+                    | EncodeJ(i_operands_[1]->AsImmediate());
+                break;
+
+            default:
+                break;
             }
+            *ptr = word;
         }
     }
 }
@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <ranges>
+#include <RiscVM/Block.hpp>
+#include <RiscVM/VM.hpp>
+
+static bool IsTerminator(const uint8_t handler)
+{
+    switch (handler)
+    {
+    case RiscVM::Handler_JAL:
+    case RiscVM::Handler_JALR:
+    case RiscVM::Handler_BEQ:
+    case RiscVM::Handler_BNE:
+    case RiscVM::Handler_BLT:
+    case RiscVM::Handler_BGE:
+    case RiscVM::Handler_BLTU:
+    case RiscVM::Handler_BGEU:
+    case RiscVM::Handler_ECALL:
+    case RiscVM::Handler_EBREAK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+RiscVM::Block* RiscVM::VM::FindBlock(const uint32_t pc)
+{
+    if (const auto it = m_Blocks.find(pc); it != m_Blocks.end())
+        return it->second.get();
+
+    if (m_Ops[pc >> 2].Handler == Handler_Invalid)
+        DecodePage(pc >> PageBits);
+    if (m_Ops[pc >> 2].Handler == Handler_Invalid)
+        return nullptr;
+
+    auto block = std::make_unique<Block>();
+    block->Begin = pc;
+
+    const auto end = std::min<size_t>(((pc >> PageBits) + 1) << PageBits, m_MemorySize & ~static_cast<size_t>(0b11));
+    for (size_t p = pc; p < end; p += 4)
+    {
+        const auto& op = m_Ops[p >> 2];
+        if (op.Handler == Handler_Invalid)
+            break;
+        block->Ops.push_back(op);
+        if (IsTerminator(op.Handler))
+            break;
+    }
+    block->Size = block->Ops.size();
+    block->Ops.emplace_back();
+
+    m_PageBlocks[pc >> PageBits].push_back(pc);
+    return (m_Blocks[pc] = std::move(block)).get();
+}
+
+void RiscVM::VM::InvalidateBlocks(const uint32_t page)
+{
+    const auto it = m_PageBlocks.find(page);
+    if (it == m_PageBlocks.end())
+        return;
+
+    // retired blocks stay allocated until CollectBlocks unlinks every chain pointing at them
+    for (const auto begin : it->second)
+    {
+        auto node = m_Blocks.extract(begin);
+        if (node.empty())
+            continue;
+        node.mapped()->Valid = false;
+        if (node.mapped()->Native)
+            m_JIT->Forget(*node.mapped());
+        m_RetiredBlocks.push_back(std::move(node.mapped()));
+    }
+    m_PageBlocks.erase(it);
+}
+
+void RiscVM::VM::FlushBlocks()
+{
+    if (m_JIT)
+        m_JIT->Flush();
+    for (auto& block : m_Blocks | std::views::values)
+    {
+        block->Valid = false;
+        m_RetiredBlocks.push_back(std::move(block));
+    }
+    m_Blocks.clear();
+    m_PageBlocks.clear();
+}
+
+void RiscVM::VM::CollectBlocks()
+{
+    if (m_RetiredBlocks.empty())
+        return;
+
+    for (const auto& block : m_Blocks | std::views::values)
+        for (auto& chain : block->Chain)
+            if (chain && !chain->Valid)
+                chain = nullptr;
+    m_RetiredBlocks.clear();
+}
+
+#if defined(__GNUC__)
+
+void RiscVM::VM::RunBlocks()
+{
+    static const void* const labels[]
+    {
+#include "labels.inl"
+    };
+    static_assert(std::size(labels) == Handler_Count);
+
+    if (!m_Ok)
+        return;
+
+    CollectBlocks();
+
+    int32_t* const x = m_Registers;
+    char* mem = m_Memory;
+    Op* ops = m_Ops;
+    size_t size = m_MemorySize;
+
+    auto pc = static_cast<uint32_t>(m_PC);
+    uint64_t n = 0;
+    uint64_t left = m_Deadline - m_Instructions;
+
+    Block* block = nullptr;
+    Block** link = nullptr;
+    const Op* base;
+    const Op* op;
+
+    // inside a block ops simply follow each other; the pc is only materialized where an op needs
+    // it. terminators leave through the chain slot of their successor and only fall back to the
+    // block map when that slot is empty or stale. the budget is checked on every block entry. a
+    // store is fenced so that a guarded one out of range faults before ops is read for it.
+#define PC() (block->Begin + (static_cast<uint32_t>(op - base) << 2))
+#define NEXT() do { ++op; goto *labels[op->Handler]; } while (false)
+#define STEP() ++op
+#define LEAVE(slot, target) \
+    do \
+    { \
+        pc = (target); \
+        link = &block->Chain[slot]; \
+        if (*link && (*link)->Begin == pc && (*link)->Valid) \
+        { \
+            block = *link; \
+            goto enter; \
+        } \
+        goto lookup; \
+    } \
+    while (false)
+#define WRITE(rd, value) do { x[rd] = (value); } while (false)
+#define LOAD(type, a) do { } while (false)
+#define EXTENSION_M() do { } while (false)
+#define STORE(type, a, value) \
+    do \
+    { \
+        const int32_t a_ = (a); \
+        *reinterpret_cast<type*>(&mem[a_]) = static_cast<type>(value); \
+        std::atomic_signal_fence(std::memory_order_seq_cst); \
+        if (ops[static_cast<uint32_t>(a_) >> 2].Handler || ops[static_cast<uint32_t>(a_ + sizeof(type) - 1) >> 2].Handler) \
+        { \
+            Invalidate(a_); \
+            Invalidate(a_ + sizeof(type) - 1); \
+            if (!block->Valid) \
+            { \
+                n -= block->Size - (op - base + 1); \
+                pc = PC() + 4; \
+                link = nullptr; \
+                goto lookup; \
+            } \
+        } \
+    } \
+    while (false)
+
+lookup:
+    if (pc >= size || pc & 0b11)
+        goto stop;
+    if (m_RetiredBlocks.size() > 64)
+    {
+        if (link && !block->Valid)
+            link = nullptr;
+        CollectBlocks();
+    }
+    m_PC = static_cast<int32_t>(pc);
+    m_Instructions += n;
+    left -= n;
+    n = 0;
+    block = FindBlock(pc);
+    if (!block)
+    {
+        Fault();
+        goto stop;
+    }
+    if (link)
+        *link = block;
+
+enter:
+    if (n >= left)
+        goto stop;
+    n += block->Size;
+    base = block->Ops.data();
+    op = base;
+    goto *labels[op->Handler];
+
+op_Invalid:
+    LEAVE(0, PC());
+
+op_JAL:
+    WRITE(op->Rd, PC() + 4);
+    LEAVE(1, PC() + op->Imm);
+op_JALR:
+    {
+        const auto target = x[op->Rs1] + op->Imm;
+        WRITE(op->Rd, PC() + 4);
+        LEAVE(1, target);
+    }
+
+op_BEQ:
+    if (x[op->Rs1] == x[op->Rs2]) LEAVE(1, PC() + op->Imm);
+    LEAVE(0, PC() + 4);
+op_BNE:
+    if (x[op->Rs1] != x[op->Rs2]) LEAVE(1, PC() + op->Imm);
+    LEAVE(0, PC() + 4);
+op_BLT:
+    if (x[op->Rs1] < x[op->Rs2]) LEAVE(1, PC() + op->Imm);
+    LEAVE(0, PC() + 4);
+op_BGE:
+    if (x[op->Rs1] >= x[op->Rs2]) LEAVE(1, PC() + op->Imm);
+    LEAVE(0, PC() + 4);
+op_BLTU:
+    if (static_cast<uint32_t>(x[op->Rs1]) < static_cast<uint32_t>(x[op->Rs2])) LEAVE(1, PC() + op->Imm);
+    LEAVE(0, PC() + 4);
+op_BGEU:
+    if (static_cast<uint32_t>(x[op->Rs1]) >= static_cast<uint32_t>(x[op->Rs2])) LEAVE(1, PC() + op->Imm);
+    LEAVE(0, PC() + 4);
+
+#include "handlers.inl"
+
+op_EBREAK:
+    EBREAK();
+    pc = PC() + 4;
+    goto stop;
+
+op_ECALL:
+    m_PC = static_cast<int32_t>(PC());
+    m_Instructions += n - 1;
+    left -= n - 1;
+    n = 1;
+    ECALL();
+    mem = m_Memory;
+    ops = m_Ops;
+    size = m_MemorySize;
+    if (!m_Ok || m_Pause)
+    {
+        pc = PC() + 4;
+        goto stop;
+    }
+    LEAVE(0, PC() + 4);
+
+#undef PC
+#undef NEXT
+#undef STEP
+#undef LEAVE
+#undef WRITE
+#undef LOAD
+#undef EXTENSION_M
+#undef STORE
+
+stop:
+    m_PC = static_cast<int32_t>(pc);
+    m_Instructions += n;
+    if (m_Ok && (pc >= size || pc & 0b11))
+        Fault();
+}
+
+#else
+
+void RiscVM::VM::RunBlocks()
+{
+    while (Cycle() && !m_Pause && m_Instructions < m_Deadline)
+    {
+    }
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <RiscVM/CallProfiler.hpp>
+#include <RiscVM/ISA.hpp>
+
+RiscVM::CallProfiler::CallProfiler()
+{
+    Clear();
+}
+
+void RiscVM::CallProfiler::Retire(VM&, const uint32_t pc, const Op& op)
+{
+    // the entry point is the root of every stack
+    if (!m_Started)
+    {
+        m_Started = true;
+        m_Nodes[0].Function = pc;
+    }
+
+    switch (m_Pending)
+    {
+    case Pending_Call:
+        Enter(pc, m_Return);
+        break;
+    case Pending_Return:
+        Leave(pc);
+        break;
+    case Pending_None:
+        break;
+    }
+    ++m_Nodes[m_Stack.back().Node].Self;
+
+    m_Pending = Pending_None;
+    if ((op.Handler == Handler_JAL || op.Handler == Handler_JALR) && op.Rd == ra)
+    {
+        m_Pending = Pending_Call;
+        m_Return = pc + 4;
+    }
+    else if (op.Handler == Handler_JALR && op.Rd == RegisterSink && op.Rs1 == ra && op.Imm == 0)
+        m_Pending = Pending_Return;
+}
+
+void RiscVM::CallProfiler::Enter(const uint32_t function, const uint32_t ret)
+{
+    const auto parent = m_Stack.back().Node;
+    const auto it = m_Nodes[parent].Children.find(function);
+    auto node = static_cast<uint32_t>(m_Nodes.size());
+    if (it != m_Nodes[parent].Children.end())
+        node = it->second;
+    else
+    {
+        m_Nodes[parent].Children.emplace(function, node);
+        m_Nodes.push_back({function, parent, 0, {}});
+    }
+    m_Stack.push_back({node, ret});
+}
+
+void RiscVM::CallProfiler::Leave(const uint32_t pc)
+{
+    // a ret normally lands on the return address of the top frame. one that lands deeper, as
+    // after a longjmp, unwinds to that frame; one that matches none only leaves the top frame
+    for (auto i = m_Stack.size(); i > 1; --i)
+        if (m_Stack[i - 1].Return == pc)
+        {
+            m_Stack.resize(i - 1);
+            return;
+        }
+    if (m_Stack.size() > 1)
+        m_Stack.pop_back();
+}
+
+void RiscVM::CallProfiler::Clear()
+{
+    m_Nodes.clear();
+    m_Nodes.push_back({0, 0, 0, {}});
+    m_Stack.clear();
+    m_Stack.push_back({0, 0});
+    m_Pending = Pending_None;
+    m_Started = false;
+}
+
+void RiscVM::CallProfiler::WriteFolded(std::ostream& stream, const SymbolMap& symbols) const
+{
+    std::vector<std::string> names(m_Nodes.size());
+    for (uint32_t i = 0; i < m_Nodes.size(); ++i)
+    {
+        // parents always come before their children
+        const auto& node = m_Nodes[i];
+        const auto name = Symbolize(symbols, node.Function);
+        names[i] = i ? names[node.Parent] + ';' + name : name;
+        if (node.Self)
+            stream << names[i] << ' ' << node.Self << '\n';
+    }
+    stream.flush();
+}
+
+void RiscVM::CallProfiler::Report(std::ostream& stream, const SymbolMap& symbols, const size_t top) const
+{
+    struct Totals
+    {
+        uint64_t Inclusive = 0;
+        uint64_t Exclusive = 0;
+    };
+
+    // subtree sums bottom up: children always come after their parents
+    std::vector<uint64_t> subtree(m_Nodes.size());
+    for (auto i = m_Nodes.size(); i-- > 0;)
+    {
+        subtree[i] += m_Nodes[i].Self;
+        if (i)
+            subtree[m_Nodes[i].Parent] += subtree[i];
+    }
+
+    std::map<uint32_t, Totals> functions;
+    for (uint32_t i = 0; i < m_Nodes.size(); ++i)
+    {
+        const auto function = m_Nodes[i].Function;
+        auto& totals = functions[function];
+        totals.Exclusive += m_Nodes[i].Self;
+
+        auto outermost = true;
+        for (auto parent = i; parent && outermost;)
+        {
+            parent = m_Nodes[parent].Parent;
+            outermost = m_Nodes[parent].Function != function;
+        }
+        if (outermost)
+            totals.Inclusive += subtree[i];
+    }
+
+    std::vector<std::pair<uint32_t, Totals>> rows(functions.begin(), functions.end());
+    const auto n = std::min(top, rows.size());
+    std::partial_sort(rows.begin(), rows.begin() + static_cast<ptrdiff_t>(n), rows.end(), [](const auto& a, const auto& b)
+    {
+        return a.second.Inclusive != b.second.Inclusive ? a.second.Inclusive > b.second.Inclusive : a.first < b.first;
+    });
+
+    const auto total = subtree[0];
+    const auto percent = [total](const uint64_t count)
+    {
+        return total ? 100.0 * static_cast<double>(count) / static_cast<double>(total) : 0.0;
+    };
+
+    stream << "call profile: " << total << " instructions in " << functions.size() << " functions\n";
+    stream << "     inclusive            exclusive\n";
+    for (size_t i = 0; i < n; ++i)
+    {
+        const auto& [function, totals] = rows[i];
+        stream
+            << std::setw(14) << totals.Inclusive << ' '
+            << std::setw(7) << std::fixed << std::setprecision(2) << percent(totals.Inclusive) << "% "
+            << std::setw(14) << totals.Exclusive << ' '
+            << std::setw(7) << percent(totals.Exclusive) << "% "
+            << Symbolize(symbols, function) << '\n';
+    }
+    stream.flush();
+}
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <RiscVM/Bind.hpp>
+#include <RiscVM/Console.hpp>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // a va_list over the guest's argument area, read the way the host reads stack arguments
+    void va_init(va_list& ap, char* ptr)
+    {
+#ifdef _WIN32
+        ap = ptr;
+#else
+        typedef struct
+        {
+            unsigned int gp_offset;
+            unsigned int fp_offset;
+            void* overflow_arg_area;
+            void* reg_save_area;
+        } va_list_t[1];
+
+        va_list_t list;
+        list->gp_offset = 6 * 8; // 6 registers * 8 bytes
+        list->fp_offset = 6 * 8 + 8 * 16; // gp_offset + 8 registers * 16 bytes
+        list->overflow_arg_area = ptr;
+        list->reg_save_area = nullptr;
+
+        memcpy(&ap, &list, sizeof(va_list_t));
+#endif
+    }
+
+    void PutChar(RiscVM::VM& vm, const int32_t c)
+    {
+        vm.IO().Put(static_cast<char>(c));
+    }
+
+    void PutString(RiscVM::VM& vm, const std::string_view string)
+    {
+        vm.IO().Write(string);
+    }
+
+    void Print(RiscVM::VM& vm, const std::string_view format, const uint32_t args)
+    {
+        if (args >= vm.MemorySize())
+        {
+            vm.Fault();
+            return;
+        }
+
+        va_list ap;
+        va_init(ap, vm.Memory() + args);
+        vm.IO().Print(format.data(), ap);
+    }
+
+    int32_t GetChar(RiscVM::VM& vm)
+    {
+        return vm.IO().Get();
+    }
+
+    void GetLine(RiscVM::VM& vm, const std::span<char> buffer)
+    {
+        vm.IO().GetLine(buffer.data(), buffer.size());
+    }
+
+    void Scan(RiscVM::VM& vm, const std::string_view format, const uint32_t args)
+    {
+        if (args >= vm.MemorySize())
+        {
+            vm.Fault();
+            return;
+        }
+
+        va_list ap;
+        va_init(ap, vm.Memory() + args);
+        vm.IO().Scan(format.data(), ap);
+    }
+}
+
+RiscVM::Console::Console()
+    : m_Sink(FileSink(stdout)), m_Source(FileSource(stdin))
+{
+    m_Out.reserve(BufferSize);
+}
+
+RiscVM::Console::~Console()
+{
+    Flush();
+}
+
+RiscVM::Console::Sink RiscVM::Console::FileSink(FILE* file)
+{
+    return [file](const char* data, const size_t size)
+    {
+        fwrite(data, 1, size, file);
+        fflush(file);
+    };
+}
+
+RiscVM::Console::Source RiscVM::Console::FileSource(FILE* file)
+{
+    return [file](char* buffer, const size_t size) -> size_t
+    {
+#ifdef _WIN32
+        return fgets(buffer, static_cast<int>(std::min<size_t>(size, INT_MAX)), file) ? strlen(buffer) : 0;
+#else
+        while (true)
+        {
+            const auto n = read(fileno(file), buffer, size);
+            if (n >= 0)
+                return static_cast<size_t>(n);
+            if (errno != EINTR)
+                return 0;
+        }
+#endif
+    };
+}
+
+RiscVM::Console::Sink RiscVM::Console::StringSink(std::string& output)
+{
+    return [&output](const char* data, const size_t size)
+    {
+        output.append(data, size);
+    };
+}
+
+RiscVM::Console::Source RiscVM::Console::StringSource(std::string input)
+{
+    return [input = std::move(input), at = size_t{0}](char* buffer, const size_t size) mutable
+    {
+        const auto n = std::min(size, input.size() - at);
+        memcpy(buffer, input.data() + at, n);
+        at += n;
+        return n;
+    };
+}
+
+RiscVM::Console::Sink& RiscVM::Console::Output()
+{
+    return m_Sink;
+}
+
+RiscVM::Console::Source& RiscVM::Console::Input()
+{
+    return m_Source;
+}
+
+RiscVM::Console::Flushing& RiscVM::Console::FlushPolicy()
+{
+    return m_Policy;
+}
+
+void RiscVM::Console::Install(ECallTable& ecall_map)
+{
+    ecall_map.Set(0, Bind<&PutChar>);
+    ecall_map.Set(1, Bind<&PutString>);
+    ecall_map.Set(2, Bind<&::Print>);
+    ecall_map.Set(3, Bind<&GetChar>);
+    ecall_map.Set(4, Bind<&::GetLine>);
+    ecall_map.Set(5, Bind<&::Scan>);
+}
+
+void RiscVM::Console::Write(const std::string_view data)
+{
+    m_Out.append(data);
+    if ((m_Policy == Flush_Line && data.find('\n') != std::string_view::npos)
+        || (m_Out.size() >= BufferSize && m_Policy != Flush_Exit))
+        Flush();
+}
+
+void RiscVM::Console::Print(const char* format, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    const auto n = vsnprintf(nullptr, 0, format, copy);
+    va_end(copy);
+    if (n <= 0)
+        return;
+
+    // vsnprintf() writes the terminator too, which the resize after it drops again
+    const auto at = m_Out.size();
+    m_Out.resize(at + n + 1);
+    vsnprintf(m_Out.data() + at, n + 1, format, args);
+    m_Out.resize(at + n);
+
+    if ((m_Policy == Flush_Line && memchr(m_Out.data() + at, '\n', n))
+        || (m_Out.size() >= BufferSize && m_Policy != Flush_Exit))
+        Flush();
+}
+
+bool RiscVM::Console::GetLine(char* buffer, const size_t size)
+{
+    if (!size)
+        return false;
+
+    size_t n = 0;
+    while (n + 1 < size)
+    {
+        if (m_InBegin == m_InEnd && !Fill())
+        {
+            if (!n)
+                return false;
+            break;
+        }
+
+        const auto available = std::min(m_InEnd - m_InBegin, size - 1 - n);
+        const auto begin = m_In.get() + m_InBegin;
+        const auto newline = static_cast<const char*>(memchr(begin, '\n', available));
+        const auto take = newline ? static_cast<size_t>(newline - begin) + 1 : available;
+        memcpy(buffer + n, begin, take);
+        m_InBegin += take;
+        n += take;
+        if (newline)
+            break;
+    }
+    buffer[n] = 0;
+    return true;
+}
+
+int RiscVM::Console::Scan(const char* format, va_list args)
+{
+    // make sure the whole line is buffered, growing the buffer for a long one
+    size_t newline;
+    while (true)
+    {
+        const auto begin = m_In.get() + m_InBegin;
+        const auto found = m_In ? static_cast<const char*>(memchr(begin, '\n', m_InEnd - m_InBegin)) : nullptr;
+        if (found)
+        {
+            newline = found - m_In.get();
+            break;
+        }
+        if (!Fill())
+        {
+            if (m_InBegin == m_InEnd)
+                return EOF;
+            newline = m_InEnd - 1;
+            break;
+        }
+    }
+
+    const std::string line(m_In.get() + m_InBegin, newline + 1 - m_InBegin);
+    m_InBegin = newline + 1;
+    return vsscanf(line.c_str(), format, args);
+}
+
+void RiscVM::Console::Flush()
+{
+    if (m_Out.empty())
+        return;
+    if (m_Sink)
+        m_Sink(m_Out.data(), m_Out.size());
+    m_Out.clear();
+}
+
+void RiscVM::Console::Discard()
+{
+    m_Out.clear();
+    m_InBegin = m_InEnd = 0;
+    m_Ended = false;
+}
+
+bool RiscVM::Console::Fill()
+{
+    if (m_Ended || !m_Source)
+        return false;
+    Flush();
+
+    if (!m_In)
+        m_In = std::make_unique<char[]>(m_InSize);
+    if (m_InBegin == m_InEnd)
+        m_InBegin = m_InEnd = 0;
+    else if (m_InEnd == m_InSize)
+    {
+        // keep what is buffered, compacted to the front, or twice the room for a line that
+        // fills the whole buffer
+        const auto kept = m_InEnd - m_InBegin;
+        if (m_InBegin == 0)
+        {
+            auto grown = std::make_unique<char[]>(m_InSize * 2);
+            memcpy(grown.get(), m_In.get(), kept);
+            m_In = std::move(grown);
+            m_InSize *= 2;
+        }
+        else
+            memmove(m_In.get(), m_In.get() + m_InBegin, kept);
+        m_InBegin = 0;
+        m_InEnd = kept;
+    }
+
+    const auto n = m_Source(m_In.get() + m_InEnd, m_InSize - m_InEnd);
+    if (!n)
+    {
+        m_Ended = true;
+        return false;
+    }
+    m_InEnd += n;
+    return true;
+}
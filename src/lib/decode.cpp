@@ -0,0 +1,221 @@
+#include <iterator>
+#include <RiscVM/ISA.hpp>
+#include <RiscVM/Op.hpp>
+
+static uint8_t Dest(const uint32_t data)
+{
+    const auto rd = RiscVM::Rd(data);
+    return rd ? static_cast<uint8_t>(rd) : RiscVM::RegisterSink;
+}
+
+static RiscVM::Op OpR(const RiscVM::Handler handler, const uint32_t data)
+{
+    return {
+        handler,
+        Dest(data),
+        static_cast<uint8_t>(RiscVM::Rs1(data)),
+        static_cast<uint8_t>(RiscVM::Rs2(data)),
+        0
+    };
+}
+
+static RiscVM::Op OpI(const RiscVM::Handler handler, const uint32_t data)
+{
+    return {
+        handler,
+        Dest(data),
+        static_cast<uint8_t>(RiscVM::Rs1(data)),
+        0,
+        RiscVM::ImmediateI(data)
+    };
+}
+
+static RiscVM::Op OpShift(const RiscVM::Handler handler, const uint32_t data)
+{
+    return {
+        handler,
+        Dest(data),
+        static_cast<uint8_t>(RiscVM::Rs1(data)),
+        0,
+        static_cast<int32_t>(RiscVM::Rs2(data))
+    };
+}
+
+static RiscVM::Op OpS(const RiscVM::Handler handler, const uint32_t data)
+{
+    return {
+        handler,
+        0,
+        static_cast<uint8_t>(RiscVM::Rs1(data)),
+        static_cast<uint8_t>(RiscVM::Rs2(data)),
+        RiscVM::ImmediateS(data)
+    };
+}
+
+static RiscVM::Op OpB(const RiscVM::Handler handler, const uint32_t data)
+{
+    return {
+        handler,
+        0,
+        static_cast<uint8_t>(RiscVM::Rs1(data)),
+        static_cast<uint8_t>(RiscVM::Rs2(data)),
+        RiscVM::ImmediateB(data)
+    };
+}
+
+static RiscVM::Op OpU(const RiscVM::Handler handler, const uint32_t data)
+{
+    return {handler, Dest(data), 0, 0, RiscVM::ImmediateU(data)};
+}
+
+static RiscVM::Op OpJ(const RiscVM::Handler handler, const uint32_t data)
+{
+    return {handler, Dest(data), 0, 0, RiscVM::ImmediateJ(data)};
+}
+
+namespace
+{
+    // level one: bits 6..2 of the opcode pick a row. level two: funct3, bit 30 (sub/sra/srai),
+    // bit 25 (the M extension) and bit 20 (ebreak) pick the handler within that row.
+    constexpr uint32_t RowOf(const uint32_t data)
+    {
+        return data >> 2 & 0b11111;
+    }
+
+    constexpr uint32_t KeyOf(const uint32_t data)
+    {
+        return (data >> 12 & 0b111) | (data >> 27 & 0b1000) | (data >> 21 & 0b10000) | (data >> 15 & 0b100000);
+    }
+
+    constexpr uint32_t KeyBits = 0x4210'7000;
+
+    constexpr uint32_t WordOf(const uint32_t key)
+    {
+        return (key & 0b111) << 12 | (key & 0b1000) << 27 | (key & 0b10000) << 21 | (key & 0b100000) << 15;
+    }
+
+    constexpr size_t CountRows()
+    {
+        bool used[32]{};
+        size_t rows = 1;
+        for (size_t i = 1; i < std::size(RiscVM::Instructions); ++i)
+            if (!used[RowOf(RiscVM::Instructions[i].Match)])
+            {
+                used[RowOf(RiscVM::Instructions[i].Match)] = true;
+                ++rows;
+            }
+        return rows;
+    }
+
+    struct DecodeTables
+    {
+        uint8_t Rows[32];
+        uint8_t Handlers[CountRows()][64];
+    };
+
+    // row 0 is all Handler_Invalid; a slot claimed twice fails the constant evaluation
+    constexpr DecodeTables MakeDecodeTables()
+    {
+        DecodeTables tables{};
+        uint8_t rows = 1;
+        for (size_t i = 1; i < std::size(RiscVM::Instructions); ++i)
+        {
+            const auto& info = RiscVM::Instructions[i];
+            auto& row = tables.Rows[RowOf(info.Match)];
+            if (!row)
+                row = rows++;
+
+            for (uint32_t key = 0; key < 64; ++key)
+            {
+                if ((WordOf(key) & info.Mask & KeyBits) != (info.Match & KeyBits))
+                    continue;
+                if (tables.Handlers[row][key])
+                    throw "two instructions share a decode slot";
+                tables.Handlers[row][key] = static_cast<uint8_t>(i);
+            }
+        }
+        return tables;
+    }
+
+    constexpr auto Tables = MakeDecodeTables();
+}
+
+RiscVM::Handler RiscVM::Identify(const uint32_t data)
+{
+    const auto handler = Tables.Handlers[Tables.Rows[RowOf(data)]][KeyOf(data)];
+    const auto& info = Instructions[handler];
+    return (data & info.Mask) == info.Match ? static_cast<Handler>(handler) : Handler_Invalid;
+}
+
+RiscVM::Op RiscVM::Decode(const uint32_t data)
+{
+    const auto handler = Identify(data);
+    switch (Instructions[handler].Form)
+    {
+    case Format_R: return OpR(handler, data);
+    case Format_I:
+    case Format_Load: return OpI(handler, data);
+    case Format_Shift: return OpShift(handler, data);
+    case Format_S: return OpS(handler, data);
+    case Format_B: return OpB(handler, data);
+    case Format_U: return OpU(handler, data);
+    case Format_J: return OpJ(handler, data);
+    case Format_Env: return {handler, 0, 0, 0, 0};
+    default: return {Handler_Invalid, 0, 0, 0, 0};
+    }
+}
+
+void RiscVM::Fuse(Op* ops, const size_t count)
+{
+    for (size_t i = 0; i + 1 < count; ++i)
+    {
+        auto& op = ops[i];
+        const auto& next = ops[i + 1];
+        if (op.Rd == RegisterSink)
+            continue;
+
+        switch (op.Handler)
+        {
+        case Handler_LUI:
+            if (next.Handler == Handler_ADDI && next.Rd == op.Rd && next.Rs1 == op.Rd)
+                op.Handler = Handler_LI;
+            break;
+
+        case Handler_AUIPC:
+            if (next.Handler == Handler_ADDI && next.Rd == op.Rd && next.Rs1 == op.Rd)
+                op.Handler = Handler_LA;
+            else if (next.Handler == Handler_JALR && next.Rs1 == op.Rd)
+                op.Handler = Handler_CALL;
+            break;
+
+        case Handler_ADDI:
+            {
+                if (op.Rs1 != op.Rd)
+                    break;
+
+                // stores keep their base in Rs2, loads in Rs1
+                size_t n = 0;
+                while (i + 1 + n < count && n < UINT8_MAX && ops[i + 1 + n].Handler == Handler_SW && ops[i + 1 + n].Rs2 == op.Rd)
+                    ++n;
+                if (n)
+                {
+                    op.Handler = Handler_PUSH;
+                    op.Rs2 = n;
+                    break;
+                }
+
+                while (i + 1 + n < count && n < UINT8_MAX && ops[i + 1 + n].Handler == Handler_LW && ops[i + 1 + n].Rs1 == op.Rd)
+                    ++n;
+                if (n)
+                {
+                    op.Handler = Handler_POP;
+                    op.Rs2 = n;
+                }
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+}
@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <RiscVM/ISA.hpp>
 #include <RiscVM/RiscVM.hpp>
 
@@ -46,6 +47,46 @@ void RiscVM::DumpRaw(const char* binary, const size_t size)
     fflush(stdout);
 }
 
+std::string RiscVM::Disassemble(const uint32_t data)
+{
+    char text[64];
+    const auto& info = Instructions[Identify(data)];
+    switch (info.Form)
+    {
+    case Format_R:
+        snprintf(text, sizeof(text), "%-7s %s,%s,%s", info.Name, RegisterName(Rd(data)), RegisterName(Rs1(data)), RegisterName(Rs2(data)));
+        break;
+    case Format_I:
+        snprintf(text, sizeof(text), "%-7s %s,%s,%d", info.Name, RegisterName(Rd(data)), RegisterName(Rs1(data)), ImmediateI(data));
+        break;
+    case Format_Shift:
+        snprintf(text, sizeof(text), "%-7s %s,%s,%u", info.Name, RegisterName(Rd(data)), RegisterName(Rs1(data)), Rs2(data));
+        break;
+    case Format_Load:
+        snprintf(text, sizeof(text), "%-7s %s,%d(%s)", info.Name, RegisterName(Rd(data)), ImmediateI(data), RegisterName(Rs1(data)));
+        break;
+    case Format_S:
+        snprintf(text, sizeof(text), "%-7s %s,%d(%s)", info.Name, RegisterName(Rs1(data)), ImmediateS(data), RegisterName(Rs2(data)));
+        break;
+    case Format_B:
+        snprintf(text, sizeof(text), "%-7s %s,%s,%d", info.Name, RegisterName(Rs1(data)), RegisterName(Rs2(data)), ImmediateB(data));
+        break;
+    case Format_U:
+        snprintf(text, sizeof(text), "%-7s %s,%d", info.Name, RegisterName(Rd(data)), ImmediateU(data));
+        break;
+    case Format_J:
+        snprintf(text, sizeof(text), "%-7s %s,%d", info.Name, RegisterName(Rd(data)), ImmediateJ(data));
+        break;
+    case Format_Env:
+        snprintf(text, sizeof(text), "%s", info.Name);
+        break;
+    default:
+        snprintf(text, sizeof(text), "?");
+        break;
+    }
+    return text;
+}
+
 void RiscVM::Dump(const char* binary, const size_t size)
 {
     for (unsigned i = 0; i < size; i += 4)
@@ -53,39 +94,7 @@ void RiscVM::Dump(const char* binary, const size_t size)
         const auto& data = *reinterpret_cast<const uint32_t*>(binary + i);
         if (!data) continue;
 
-        printf("%08X: ", data);
-
-        switch (data & 0b1111111)
-        {
-        case RV32_64G_OP:
-            Format::R{.Data = data}.Dump();
-            break;
-        case RV32_64G_OP_IMM:
-        case RV32_64G_JALR:
-        case RV32_64G_LOAD:
-        case RV32_64G_SYSTEM:
-        case RV32_64G_MISC_MEM:
-            Format::I{.Data = data}.Dump();
-            break;
-        case RV32_64G_STORE:
-            Format::S{.Data = data}.Dump();
-            break;
-        case RV32_64G_BRANCH:
-            Format::B{.Data = data}.Dump();
-            break;
-        case RV32_64G_LUI:
-        case RV32_64G_AUIPC:
-            Format::U{.Data = data}.Dump();
-            break;
-        case RV32_64G_JAL:
-            Format::J{.Data = data}.Dump();
-            break;
-        default:
-            printf("?");
-            break;
-        }
-
-        printf("\n");
+        printf("%08X: %s\n", data, Disassemble(data).c_str());
     }
 
     fflush(stdout);
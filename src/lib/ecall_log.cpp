@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <RiscVM/ECallLog.hpp>
+
+namespace
+{
+    constexpr char Magic[4] = {'R', 'V', 'E', 'C'};
+    constexpr uint8_t Version = 1;
+
+    // differing bytes closer than this are logged as one run
+    constexpr size_t Gap = 8;
+
+    // up to this many pages the guest wrote before an ecall are compared against copies after
+    // it; past that, write-protecting them again is cheaper than comparing them every time
+    constexpr size_t ComparedPages = 16;
+
+    void Put32(std::ostream& stream, const uint32_t value)
+    {
+        const char bytes[4]
+        {
+            static_cast<char>(value),
+            static_cast<char>(value >> 8),
+            static_cast<char>(value >> 16),
+            static_cast<char>(value >> 24),
+        };
+        stream.write(bytes, sizeof(bytes));
+    }
+
+    uint32_t Get32(std::istream& stream)
+    {
+        unsigned char bytes[4];
+        if (!stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+            throw std::runtime_error("truncated ecall log");
+        return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+    }
+
+    uint8_t Get8(std::istream& stream)
+    {
+        const auto c = stream.get();
+        if (c == std::char_traits<char>::eof())
+            throw std::runtime_error("truncated ecall log");
+        return static_cast<uint8_t>(c);
+    }
+
+    // the runs of bytes that differ between before and after, n bytes from address on
+    void AppendRuns(RiscVM::ECallLog::Effect& effect, const uint32_t address, const char* before, const char* after, const size_t n)
+    {
+        if (!memcmp(before, after, n))
+            return;
+
+        for (size_t at = 0; at < n;)
+        {
+            if (before[at] == after[at])
+            {
+                ++at;
+                continue;
+            }
+            auto last = at + 1;
+            for (auto i = last; i < n && i < last + Gap; ++i)
+                if (before[i] != after[i])
+                    last = i + 1;
+
+            // a run that crosses into the next page continues the one before it
+            auto& writes = effect.Writes;
+            if (!writes.empty() && writes.back().first + writes.back().second.size() == address + at)
+                writes.back().second.append(after + at, last - at);
+            else
+                writes.emplace_back(static_cast<uint32_t>(address + at), std::string(after + at, last - at));
+            at = last;
+        }
+    }
+
+    std::string Hex(const uint32_t value)
+    {
+        std::ostringstream stream;
+        stream << std::hex << value;
+        return stream.str();
+    }
+}
+
+void RiscVM::ECallLog::Record(VM& vm)
+{
+    m_Effects.clear();
+    m_Next = 0;
+
+    auto& ecall_map = vm.ECallMap();
+    for (const auto number : ecall_map.Numbers())
+    {
+        ecall_map.Set(number, [this, number, call = ecall_map.Get(number)](VM& vm_)
+        {
+            // with writes tracked, only the pages the handler writes are compared, see
+            // VM::Watch(); without, all of them
+            const auto compare = vm_.DirtyPages() <= ComparedPages;
+            const auto watched = vm_.Watch(!compare);
+            if (!watched)
+                Sync(vm_);
+            else if (compare)
+                SyncWritten(vm_);
+            int32_t before[32];
+            std::copy_n(vm_.Registers(), 32, before);
+
+            try
+            {
+                call(vm_);
+            }
+            catch (...)
+            {
+                vm_.Unwatch([](uint32_t, const char*, size_t) {});
+                throw;
+            }
+
+            auto& effect = m_Effects.emplace_back();
+            effect.PC = static_cast<uint32_t>(vm_.PC());
+            effect.Number = number;
+            effect.Ok = vm_.Ok();
+            effect.Status = vm_.Status();
+            for (uint32_t r = 1; r < 32; ++r)
+                if (vm_.Registers()[r] != before[r])
+                    effect.Registers.emplace_back(r, vm_.Registers()[r]);
+            if (watched)
+            {
+                if (compare)
+                    DiffWritten(vm_, effect);
+                const auto memory = vm_.Memory();
+                vm_.Unwatch([&effect, memory](const uint32_t address, const char* page, const size_t size)
+                {
+                    AppendRuns(effect, address, page, memory + address, size);
+                });
+            }
+            else
+                Diff(vm_, effect);
+        });
+    }
+}
+
+void RiscVM::ECallLog::Replay(VM& vm)
+{
+    m_Next = 0;
+    auto& ecall_map = vm.ECallMap();
+    for (const auto number : ecall_map.Numbers())
+    {
+        ecall_map.Set(number, [this, number](VM& vm_)
+        {
+            Apply(vm_, number);
+        });
+    }
+}
+
+const std::vector<RiscVM::ECallLog::Effect>& RiscVM::ECallLog::Effects() const
+{
+    return m_Effects;
+}
+
+void RiscVM::ECallLog::Sync(const VM& vm)
+{
+    const auto memory = vm.Memory();
+    const auto size = vm.MemorySize();
+    if (size != m_ShadowSize)
+    {
+        m_Shadow.reset(static_cast<char*>(calloc(size, 1)));
+        m_ShadowSize = m_Shadow ? size : 0;
+        if (!m_Shadow)
+            throw std::bad_alloc();
+    }
+
+    // whatever the guest stored since the last ecall is not the handler's doing
+    const auto shadow = m_Shadow.get();
+    for (size_t page = 0; page < size; page += VM::PageSize)
+    {
+        const auto n = std::min<size_t>(VM::PageSize, size - page);
+        if (memcmp(shadow + page, memory + page, n))
+            memcpy(shadow + page, memory + page, n);
+    }
+}
+
+void RiscVM::ECallLog::Diff(const VM& vm, Effect& effect)
+{
+    const auto memory = vm.Memory();
+    const auto shadow = m_Shadow.get();
+    const auto size = std::min(vm.MemorySize(), m_ShadowSize);
+    for (size_t page = 0; page < size; page += VM::PageSize)
+    {
+        const auto end = std::min<size_t>(page + VM::PageSize, size);
+        if (!memcmp(shadow + page, memory + page, end - page))
+            continue;
+
+        AppendRuns(effect, static_cast<uint32_t>(page), shadow + page, memory + page, end - page);
+        memcpy(shadow + page, memory + page, end - page);
+    }
+}
+
+void RiscVM::ECallLog::SyncWritten(const VM& vm)
+{
+    // the guest may have changed them since, and the handler can write them without a fault
+    const auto memory = vm.Memory();
+    const auto page = vm.DirtyPageSize();
+    const auto log = vm.DirtyLog();
+    m_Written.assign(log.begin(), log.end());
+    for (const auto index : m_Written)
+    {
+        const auto address = index * page;
+        const auto n = std::min(page, vm.MemorySize() - address);
+        auto& copy = m_Pages[index];
+        if (!copy)
+            copy = std::make_unique_for_overwrite<char[]>(page);
+        memcpy(copy.get(), memory + address, n);
+    }
+}
+
+void RiscVM::ECallLog::DiffWritten(const VM& vm, Effect& effect)
+{
+    const auto memory = vm.Memory();
+    const auto page = vm.DirtyPageSize();
+    for (const auto index : m_Written)
+    {
+        const auto address = index * page;
+        const auto n = std::min(page, vm.MemorySize() - address);
+        AppendRuns(effect, static_cast<uint32_t>(address), m_Pages[index].get(), memory + address, n);
+    }
+}
+
+void RiscVM::ECallLog::Apply(VM& vm, const int number)
+{
+    if (m_Next >= m_Effects.size())
+        throw std::runtime_error("replay made more ecalls than were recorded");
+    const auto& effect = m_Effects[m_Next];
+    if (effect.PC != static_cast<uint32_t>(vm.PC()) || effect.Number != number)
+        throw std::runtime_error(
+            "replay diverged at pc " + Hex(vm.PC()) + ", ecall " + std::to_string(number)
+            + " where pc " + Hex(effect.PC) + ", ecall " + std::to_string(effect.Number) + " was recorded");
+    ++m_Next;
+
+    for (const auto& [r, value] : effect.Registers)
+        vm.R(r) = value;
+    for (const auto& [address, bytes] : effect.Writes)
+    {
+        if (static_cast<uint64_t>(address) + bytes.size() > vm.MemorySize())
+            throw std::runtime_error("recorded write at " + Hex(address) + " lies outside guest memory");
+        memcpy(vm.Memory() + address, bytes.data(), bytes.size());
+    }
+    vm.Ok() = effect.Ok;
+    vm.Status() = effect.Status;
+}
+
+void RiscVM::ECallLog::Write(std::ostream& stream) const
+{
+    stream.write(Magic, sizeof(Magic));
+    stream.put(static_cast<char>(Version));
+    Put32(stream, static_cast<uint32_t>(m_Effects.size()));
+
+    for (const auto& effect : m_Effects)
+    {
+        Put32(stream, effect.PC);
+        Put32(stream, static_cast<uint32_t>(effect.Number));
+        stream.put(static_cast<char>(effect.Ok));
+        Put32(stream, static_cast<uint32_t>(effect.Status));
+
+        stream.put(static_cast<char>(effect.Registers.size()));
+        for (const auto& [r, value] : effect.Registers)
+        {
+            stream.put(static_cast<char>(r));
+            Put32(stream, static_cast<uint32_t>(value));
+        }
+
+        Put32(stream, static_cast<uint32_t>(effect.Writes.size()));
+        for (const auto& [address, bytes] : effect.Writes)
+        {
+            Put32(stream, address);
+            Put32(stream, static_cast<uint32_t>(bytes.size()));
+            stream.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        }
+    }
+}
+
+RiscVM::ECallLog RiscVM::ECallLog::Read(std::istream& stream)
+{
+    char magic[sizeof(Magic)];
+    if (!stream.read(magic, sizeof(magic)) || memcmp(magic, Magic, sizeof(Magic)) || stream.get() != Version)
+        throw std::runtime_error("not an ecall log");
+
+    ECallLog log;
+    const auto count = Get32(stream);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        auto& effect = log.m_Effects.emplace_back();
+        effect.PC = Get32(stream);
+        effect.Number = static_cast<int32_t>(Get32(stream));
+        effect.Ok = Get8(stream);
+        effect.Status = static_cast<int32_t>(Get32(stream));
+
+        const auto registers = Get8(stream);
+        for (uint32_t j = 0; j < registers; ++j)
+        {
+            const auto r = Get8(stream);
+            if (r == 0 || r >= 32)
+                throw std::runtime_error("bad register in ecall log");
+            effect.Registers.emplace_back(r, static_cast<int32_t>(Get32(stream)));
+        }
+
+        const auto writes = Get32(stream);
+        for (uint32_t j = 0; j < writes; ++j)
+        {
+            const auto address = Get32(stream);
+            std::string bytes(Get32(stream), '\0');
+            if (!stream.read(bytes.data(), static_cast<std::streamsize>(bytes.size())))
+                throw std::runtime_error("truncated ecall log");
+            effect.Writes.emplace_back(address, std::move(bytes));
+        }
+    }
+    return log;
+}
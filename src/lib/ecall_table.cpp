@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <RiscVM/ECallTable.hpp>
+
+RiscVM::ECallTable::ECallTable(const ECallTable& other)
+{
+    *this = other;
+}
+
+RiscVM::ECallTable& RiscVM::ECallTable::operator=(const ECallTable& other)
+{
+    if (this == &other)
+        return *this;
+
+    std::copy(std::begin(other.m_Functions), std::end(other.m_Functions), m_Functions);
+    if (!other.m_Closures)
+        m_Closures.reset();
+    else
+    {
+        if (!m_Closures)
+            m_Closures = std::make_unique<ECall[]>(Size);
+        std::copy_n(other.m_Closures.get(), Size, m_Closures.get());
+    }
+    return *this;
+}
+
+void RiscVM::ECallTable::Erase(const int number)
+{
+    const auto n = Index(number);
+    m_Functions[n] = nullptr;
+    if (m_Closures)
+        m_Closures[n] = nullptr;
+}
+
+bool RiscVM::ECallTable::Contains(const int number) const
+{
+    const auto n = static_cast<uint32_t>(number);
+    return n < Size && (m_Functions[n] || (m_Closures && m_Closures[n]));
+}
+
+RiscVM::ECall RiscVM::ECallTable::Get(const int number) const
+{
+    const auto n = static_cast<uint32_t>(number);
+    if (n >= Size)
+        return {};
+    if (m_Functions[n])
+        return m_Functions[n];
+    return m_Closures ? m_Closures[n] : ECall{};
+}
+
+std::vector<int> RiscVM::ECallTable::Numbers() const
+{
+    std::vector<int> numbers;
+    for (uint32_t n = 0; n < Size; ++n)
+        if (Contains(static_cast<int>(n)))
+            numbers.push_back(static_cast<int>(n));
+    return numbers;
+}
+
+uint32_t RiscVM::ECallTable::Index(const int number)
+{
+    const auto n = static_cast<uint32_t>(number);
+    if (n >= Size)
+        throw std::out_of_range("ecall " + std::to_string(number) + " is outside the table");
+    return n;
+}
@@ -0,0 +1,172 @@
+// straight-line handlers shared by the computed-goto engines. the including engine provides the
+// control flow labels (op_Invalid, op_JAL, op_JALR, op_Bxx, op_ECALL, op_EBREAK) and defines
+// PC() as the address of the current op, WRITE(rd, value), STORE(type, addr, value), NEXT() and
+// STEP(), which moves op to the following slot inside a superinstruction. LOAD(type, addr) checks
+// a load before it happens and EXTENSION_M() starts every RV32M op; both may leave the handler.
+
+op_LUI:
+    WRITE(op->Rd, op->Imm);
+    NEXT();
+op_AUIPC:
+    WRITE(op->Rd, op->Imm + static_cast<int32_t>(PC()));
+    NEXT();
+
+op_LB:
+    LOAD(int8_t, x[op->Rs1] + op->Imm);
+    WRITE(op->Rd, static_cast<uint8_t>(*reinterpret_cast<int8_t*>(&mem[x[op->Rs1] + op->Imm])));
+    NEXT();
+op_LH:
+    LOAD(int16_t, x[op->Rs1] + op->Imm);
+    WRITE(op->Rd, *reinterpret_cast<int16_t*>(&mem[x[op->Rs1] + op->Imm]));
+    NEXT();
+op_LW:
+    LOAD(int32_t, x[op->Rs1] + op->Imm);
+    WRITE(op->Rd, *reinterpret_cast<int32_t*>(&mem[x[op->Rs1] + op->Imm]));
+    NEXT();
+op_LBU:
+    LOAD(uint8_t, x[op->Rs1] + op->Imm);
+    WRITE(op->Rd, *reinterpret_cast<uint8_t*>(&mem[x[op->Rs1] + op->Imm]));
+    NEXT();
+op_LHU:
+    LOAD(uint16_t, x[op->Rs1] + op->Imm);
+    WRITE(op->Rd, *reinterpret_cast<uint16_t*>(&mem[x[op->Rs1] + op->Imm]));
+    NEXT();
+
+op_SB:
+    STORE(int8_t, x[op->Rs2] + op->Imm, x[op->Rs1]);
+    NEXT();
+op_SH:
+    STORE(int16_t, x[op->Rs2] + op->Imm, x[op->Rs1]);
+    NEXT();
+op_SW:
+    STORE(int32_t, x[op->Rs2] + op->Imm, x[op->Rs1]);
+    NEXT();
+
+op_ADDI:
+    WRITE(op->Rd, x[op->Rs1] + op->Imm);
+    NEXT();
+op_SLTI:
+    WRITE(op->Rd, x[op->Rs1] < op->Imm);
+    NEXT();
+op_SLTIU:
+    WRITE(op->Rd, static_cast<uint32_t>(x[op->Rs1]) < static_cast<uint32_t>(op->Imm));
+    NEXT();
+op_XORI:
+    WRITE(op->Rd, x[op->Rs1] ^ op->Imm);
+    NEXT();
+op_ORI:
+    WRITE(op->Rd, x[op->Rs1] | op->Imm);
+    NEXT();
+op_ANDI:
+    WRITE(op->Rd, x[op->Rs1] & op->Imm);
+    NEXT();
+op_SLLI:
+    WRITE(op->Rd, x[op->Rs1] << op->Imm);
+    NEXT();
+op_SRLI:
+    WRITE(op->Rd, x[op->Rs1] >> op->Imm);
+    NEXT();
+op_SRAI:
+    WRITE(op->Rd, x[op->Rs1] >> op->Imm);
+    NEXT();
+
+op_ADD:
+    WRITE(op->Rd, x[op->Rs1] + x[op->Rs2]);
+    NEXT();
+op_SUB:
+    WRITE(op->Rd, x[op->Rs1] - x[op->Rs2]);
+    NEXT();
+op_SLL:
+    WRITE(op->Rd, x[op->Rs1] << (x[op->Rs2] & 31));
+    NEXT();
+op_SLT:
+    WRITE(op->Rd, x[op->Rs1] < x[op->Rs2]);
+    NEXT();
+op_SLTU:
+    WRITE(op->Rd, static_cast<uint32_t>(x[op->Rs1]) < static_cast<uint32_t>(x[op->Rs2]));
+    NEXT();
+op_XOR:
+    WRITE(op->Rd, x[op->Rs1] ^ x[op->Rs2]);
+    NEXT();
+op_SRL:
+    WRITE(op->Rd, x[op->Rs1] >> (x[op->Rs2] & 31));
+    NEXT();
+op_SRA:
+    WRITE(op->Rd, x[op->Rs1] >> (x[op->Rs2] & 31));
+    NEXT();
+op_OR:
+    WRITE(op->Rd, x[op->Rs1] | x[op->Rs2]);
+    NEXT();
+op_AND:
+    WRITE(op->Rd, x[op->Rs1] & x[op->Rs2]);
+    NEXT();
+
+op_FENCE:
+    NEXT();
+
+op_MUL:
+    EXTENSION_M();
+    WRITE(op->Rd, x[op->Rs1] * x[op->Rs2]);
+    NEXT();
+op_MULH:
+    EXTENSION_M();
+    WRITE(op->Rd, static_cast<int16_t>(x[op->Rs1]) * static_cast<int16_t>(x[op->Rs2]));
+    NEXT();
+op_MULHSU:
+    EXTENSION_M();
+    WRITE(op->Rd, static_cast<int16_t>(x[op->Rs1]) * static_cast<uint16_t>(x[op->Rs2]));
+    NEXT();
+op_MULHU:
+    EXTENSION_M();
+    WRITE(op->Rd, static_cast<uint16_t>(x[op->Rs1]) * static_cast<uint16_t>(x[op->Rs2]));
+    NEXT();
+op_DIV:
+    EXTENSION_M();
+    WRITE(op->Rd, x[op->Rs1] / x[op->Rs2]);
+    NEXT();
+op_DIVU:
+    EXTENSION_M();
+    WRITE(op->Rd, static_cast<int32_t>(static_cast<uint32_t>(x[op->Rs1]) / static_cast<uint32_t>(x[op->Rs2])));
+    NEXT();
+op_REM:
+    EXTENSION_M();
+    WRITE(op->Rd, x[op->Rs1] % x[op->Rs2]);
+    NEXT();
+op_REMU:
+    EXTENSION_M();
+    WRITE(op->Rd, static_cast<int32_t>(static_cast<uint32_t>(x[op->Rs1]) % static_cast<uint32_t>(x[op->Rs2])));
+    NEXT();
+
+op_LA:
+    WRITE(op->Rd, static_cast<int32_t>(PC()) + op->Imm + op[1].Imm);
+    STEP();
+    NEXT();
+op_LI:
+    WRITE(op->Rd, op->Imm + op[1].Imm);
+    STEP();
+    NEXT();
+op_CALL:
+    WRITE(op->Rd, op->Imm + static_cast<int32_t>(PC()));
+    STEP();
+    goto op_JALR;
+op_PUSH:
+    {
+        WRITE(op->Rd, x[op->Rs1] + op->Imm);
+        for (auto count = op->Rs2; count; --count)
+        {
+            STEP();
+            STORE(int32_t, x[op->Rs2] + op->Imm, x[op->Rs1]);
+        }
+    }
+    NEXT();
+op_POP:
+    {
+        WRITE(op->Rd, x[op->Rs1] + op->Imm);
+        for (auto count = op->Rs2; count; --count)
+        {
+            STEP();
+            LOAD(int32_t, x[op->Rs1] + op->Imm);
+            WRITE(op->Rd, *reinterpret_cast<int32_t*>(&mem[x[op->Rs1] + op->Imm]));
+        }
+    }
+    NEXT();
@@ -0,0 +1,751 @@
+#include <RiscVM/JIT.hpp>
+
+#if RISCVM_HAS_JIT
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <ranges>
+#include <stdexcept>
+#include <sys/mman.h>
+#include "x64.hpp"
+
+using namespace RiscVM::X64;
+
+namespace
+{
+    // while compiled code runs, rbx points at the guest register file, rbp at guest memory and
+    // r12 at the JitContext. rax, rcx and rdx are scratch, the rest hold pinned guest registers.
+    constexpr Reg Registers = RBX;
+    constexpr Reg Memory = RBP;
+    constexpr Reg Context = R12;
+    constexpr Reg Pinnable[]{RSI, RDI, R8, R9, R10, R11, R13, R14, R15};
+
+    constexpr uint8_t Field_Rd = 1;
+    constexpr uint8_t Field_Rs1 = 2;
+    constexpr uint8_t Field_Rs2 = 4;
+
+    Mem Ctx(const size_t offset)
+    {
+        return {Context, static_cast<int32_t>(offset)};
+    }
+
+    Operand OpReg(const Reg r)
+    {
+        return {.Kind = Operand::Kind_Reg, .R = r};
+    }
+
+    Operand OpMem(const Mem& m)
+    {
+        return {.Kind = Operand::Kind_Mem, .M = m};
+    }
+
+    Operand OpImm(const int32_t imm)
+    {
+        return {.Kind = Operand::Kind_Imm, .Imm = imm};
+    }
+
+    // decoded ops name the sink slot instead of x0; the compiler folds it back onto x0, whose
+    // writes it drops
+    unsigned Dest(const RiscVM::Op& op)
+    {
+        return op.Rd == RiscVM::RegisterSink ? 0 : op.Rd;
+    }
+
+    uint8_t Fields(const uint8_t handler)
+    {
+        switch (RiscVM::Unfuse(static_cast<RiscVM::Handler>(handler)))
+        {
+        case RiscVM::Handler_LUI:
+        case RiscVM::Handler_AUIPC:
+        case RiscVM::Handler_JAL:
+            return Field_Rd;
+        case RiscVM::Handler_JALR:
+        case RiscVM::Handler_LB:
+        case RiscVM::Handler_LH:
+        case RiscVM::Handler_LW:
+        case RiscVM::Handler_LBU:
+        case RiscVM::Handler_LHU:
+        case RiscVM::Handler_ADDI:
+        case RiscVM::Handler_SLTI:
+        case RiscVM::Handler_SLTIU:
+        case RiscVM::Handler_XORI:
+        case RiscVM::Handler_ORI:
+        case RiscVM::Handler_ANDI:
+        case RiscVM::Handler_SLLI:
+        case RiscVM::Handler_SRLI:
+        case RiscVM::Handler_SRAI:
+            return Field_Rd | Field_Rs1;
+        case RiscVM::Handler_BEQ:
+        case RiscVM::Handler_BNE:
+        case RiscVM::Handler_BLT:
+        case RiscVM::Handler_BGE:
+        case RiscVM::Handler_BLTU:
+        case RiscVM::Handler_BGEU:
+        case RiscVM::Handler_SB:
+        case RiscVM::Handler_SH:
+        case RiscVM::Handler_SW:
+            return Field_Rs1 | Field_Rs2;
+        case RiscVM::Handler_FENCE:
+        case RiscVM::Handler_ECALL:
+        case RiscVM::Handler_EBREAK:
+            return 0;
+        default:
+            return Field_Rd | Field_Rs1 | Field_Rs2;
+        }
+    }
+
+    /**
+     * Translates one block. Pinned guest registers are loaded on entry and written back before
+     * every exit, so blocks can jump straight into each other without going through memory for
+     * anything but the register file.
+     */
+    class Compiler
+    {
+    public:
+        Compiler(Emitter& e, const uint8_t* exit, const uint8_t* indirect_exit, const uint8_t* budget_exit)
+            : e(e), m_Exit(exit), m_IndirectExit(indirect_exit), m_BudgetExit(budget_exit)
+        {
+        }
+
+        void Compile(const RiscVM::Block& block)
+        {
+            Allocate(block);
+
+            // linked and indirect jumps both land here, so this one check bounds every chain
+            m_Begin = block.Begin;
+            e.MovRM(RAX, Ctx(offsetof(RiscVM::JitContext, Instructions)), true);
+            e.RM({0x3b}, RAX, Ctx(offsetof(RiscVM::JitContext, Budget)), true);
+            m_BudgetSite = e.Jcc(Cond_AE, nullptr);
+
+            const auto& last = block.Ops[block.Size - 1];
+            const bool interpret_last = last.Handler == RiscVM::Handler_ECALL || last.Handler == RiscVM::Handler_EBREAK;
+            if (const auto count = block.Size - interpret_last)
+                e.AluMI(Alu_Add, Ctx(offsetof(RiscVM::JitContext, Instructions)), static_cast<int32_t>(count), true);
+
+            for (unsigned r = 1; r < 32; ++r)
+                if (m_Host[r] != NoReg)
+                    e.MovRM(m_Host[r], Guest(r));
+
+            for (uint32_t i = 0; i < block.Size; ++i)
+                Emit(block.Ops[i], block.Begin + (i << 2), block.Size - i - 1);
+
+            if (!IsTerminator(last.Handler))
+            {
+                WriteBack();
+                DirectExit(block.Begin + (block.Size << 2));
+            }
+
+            EmitStubs();
+        }
+
+    private:
+        struct Stub
+        {
+            uint8_t* Site;
+            bool Store;
+            uint32_t PC;
+            uint32_t Remaining;
+            uint32_t StoreSize;
+        };
+
+        static bool IsTerminator(const uint8_t handler)
+        {
+            switch (handler)
+            {
+            case RiscVM::Handler_JAL:
+            case RiscVM::Handler_JALR:
+            case RiscVM::Handler_BEQ:
+            case RiscVM::Handler_BNE:
+            case RiscVM::Handler_BLT:
+            case RiscVM::Handler_BGE:
+            case RiscVM::Handler_BLTU:
+            case RiscVM::Handler_BGEU:
+            case RiscVM::Handler_ECALL:
+            case RiscVM::Handler_EBREAK:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        static Mem Guest(const unsigned r)
+        {
+            return {Registers, static_cast<int32_t>(r << 2)};
+        }
+
+        void Allocate(const RiscVM::Block& block)
+        {
+            unsigned uses[32]{};
+            for (uint32_t i = 0; i < block.Size; ++i)
+            {
+                const auto& op = block.Ops[i];
+                const auto fields = Fields(op.Handler);
+                if (fields & Field_Rd)
+                {
+                    ++uses[Dest(op)];
+                    m_Written[Dest(op)] = true;
+                }
+                if (fields & Field_Rs1)
+                    ++uses[op.Rs1];
+                if (fields & Field_Rs2)
+                    ++uses[op.Rs2];
+            }
+            uses[0] = 0;
+            m_Written[0] = false;
+
+            unsigned order[32];
+            std::iota(std::begin(order), std::end(order), 0);
+            std::stable_sort(std::begin(order), std::end(order), [&](const unsigned a, const unsigned b) { return uses[a] > uses[b]; });
+
+            std::fill(std::begin(m_Host), std::end(m_Host), NoReg);
+            for (unsigned i = 0; i < std::size(Pinnable) && uses[order[i]] >= 2; ++i)
+                m_Host[order[i]] = Pinnable[i];
+        }
+
+        Operand Src(const unsigned r) const
+        {
+            if (r == 0)
+                return OpImm(0);
+            if (m_Host[r] != NoReg)
+                return OpReg(m_Host[r]);
+            return OpMem(Guest(r));
+        }
+
+        void Get(const Reg dst, const unsigned r)
+        {
+            e.Load(dst, Src(r));
+        }
+
+        void Put(const unsigned r, const Reg src)
+        {
+            if (r == 0)
+                return;
+            if (m_Host[r] != NoReg)
+                e.MovRR(m_Host[r], src);
+            else
+                e.MovMR(Guest(r), src);
+        }
+
+        void PutImm(const unsigned r, const int32_t imm)
+        {
+            if (r == 0)
+                return;
+            if (m_Host[r] != NoReg)
+                e.MovRI(m_Host[r], imm);
+            else
+                e.MovMI(Guest(r), imm);
+        }
+
+        void WriteBack()
+        {
+            for (unsigned r = 1; r < 32; ++r)
+                if (m_Host[r] != NoReg && m_Written[r])
+                    e.MovMR(Guest(r), m_Host[r]);
+        }
+
+        // rd = rs1 <alu> src, computed in place when rd is pinned and src does not alias it
+        void Binary(const Alu alu, const unsigned rd, const unsigned rs1, const Operand& src)
+        {
+            auto dst = m_Host[rd];
+            if (dst == NoReg || (src.Kind == Operand::Kind_Reg && src.R == dst))
+                dst = RAX;
+            Get(dst, rs1);
+            e.AluOp(alu, dst, src);
+            if (dst == RAX)
+                Put(rd, RAX);
+        }
+
+        void Compare(const Cond cond, const unsigned rd, const unsigned rs1, const Operand& src)
+        {
+            Get(RAX, rs1);
+            e.AluOp(Alu_Cmp, RAX, src);
+            e.SetRax(cond);
+            Put(rd, RAX);
+        }
+
+        void ShiftImm(const Shift shift, const unsigned rd, const unsigned rs1, const int32_t imm)
+        {
+            Get(RAX, rs1);
+            e.ShiftRI(shift, RAX, imm & 31);
+            Put(rd, RAX);
+        }
+
+        void ShiftReg(const Shift shift, const unsigned rd, const unsigned rs1, const unsigned rs2)
+        {
+            Get(RCX, rs2);
+            Get(RAX, rs1);
+            e.ShiftRCl(shift, RAX);
+            Put(rd, RAX);
+        }
+
+        // eax = x[rs1] + imm, sign-extended into rax for indexing guest memory
+        void Address(const unsigned rs1, const int32_t imm)
+        {
+            Get(RAX, rs1);
+            if (imm)
+                e.AluOp(Alu_Add, RAX, OpImm(imm));
+        }
+
+        void LoadOp(const std::initializer_list<uint8_t> opcode, const RiscVM::Op& op)
+        {
+            Address(op.Rs1, op.Imm);
+            e.Movsxd(RDX, RAX);
+            e.RM(opcode, RAX, {Memory, 0, RDX, 0});
+            Put(op.Rd, RAX);
+        }
+
+        void StoreOp(const unsigned size, const RiscVM::Op& op, const uint32_t pc, const uint32_t remaining)
+        {
+            // operands stay swapped the way the interpreter reads them: rs2 is the base
+            Address(op.Rs2, op.Imm);
+            e.Movsxd(RDX, RAX);
+            Get(RCX, op.Rs1);
+            const Mem target{Memory, 0, RDX, 0};
+            switch (size)
+            {
+            case 1:
+                e.RM({0x88}, RCX, target);
+                break;
+            case 2:
+                e.Byte(0x66);
+                e.RM({0x89}, RCX, target);
+                break;
+            default:
+                e.RM({0x89}, RCX, target);
+                break;
+            }
+
+            // leave the block if the store touched decoded code, so the dispatcher can invalidate it
+            e.MovRM(RDX, Ctx(offsetof(RiscVM::JitContext, Ops)), true);
+            e.MovRR(RCX, RAX);
+            e.ShiftRI(Shift_Shr, RCX, 2);
+            e.CmpMI8({RDX, 0, RCX, 3}, 0);
+            m_Stubs.push_back({e.Jcc(Cond_NE, nullptr), true, pc + 4, remaining, size});
+            if (size > 1)
+            {
+                e.Lea(RCX, {RAX, static_cast<int32_t>(size - 1)});
+                e.ShiftRI(Shift_Shr, RCX, 2);
+                e.CmpMI8({RDX, 0, RCX, 3}, 0);
+                m_Stubs.push_back({e.Jcc(Cond_NE, nullptr), true, pc + 4, remaining, size});
+            }
+        }
+
+        void Branch(const Cond cond, const RiscVM::Op& op, const uint32_t pc)
+        {
+            WriteBack();
+            Get(RAX, op.Rs1);
+            e.AluOp(Alu_Cmp, RAX, Src(op.Rs2));
+            m_Stubs.push_back({e.Jcc(cond, nullptr), false, pc + op.Imm, 0, 0});
+            DirectExit(pc + 4);
+        }
+
+        void DirectExit(const uint32_t target)
+        {
+            m_Stubs.push_back({e.Jmp(nullptr), false, target, 0, 0});
+        }
+
+        void Emit(RiscVM::Op op, const uint32_t pc, const uint32_t remaining)
+        {
+            using namespace RiscVM;
+
+            // the slots behind a superinstruction are part of the block as well, so compile it
+            // as its first instruction and let the followers compile on their own
+            op.Handler = Unfuse(static_cast<Handler>(op.Handler));
+            op.Rd = Dest(op);
+
+            // writes to x0 have no effect; the interpreter would still fault on a bad address,
+            // but nothing observable depends on that
+            if (Fields(op.Handler) & Field_Rd && op.Rd == 0 && op.Handler != Handler_JAL && op.Handler != Handler_JALR)
+                return;
+
+            switch (op.Handler)
+            {
+            case Handler_LUI:
+                PutImm(op.Rd, op.Imm);
+                break;
+            case Handler_AUIPC:
+                PutImm(op.Rd, static_cast<int32_t>(pc) + op.Imm);
+                break;
+
+            case Handler_JAL:
+                PutImm(op.Rd, static_cast<int32_t>(pc + 4));
+                WriteBack();
+                DirectExit(pc + op.Imm);
+                break;
+            case Handler_JALR:
+                Address(op.Rs1, op.Imm);
+                PutImm(op.Rd, static_cast<int32_t>(pc + 4));
+                WriteBack();
+                e.MovRR(RCX, RAX);
+                e.AluOp(Alu_And, RCX, OpImm(((1 << RiscVM::JIT::TableBits) - 1) << 2));
+                e.MovRM(RDX, Ctx(offsetof(RiscVM::JitContext, Table)), true);
+                e.RM({0x39}, RAX, {RDX, 0, RCX, 2});
+                e.Jcc(Cond_NE, m_IndirectExit);
+                e.JmpM({RDX, static_cast<int32_t>(offsetof(RiscVM::JitEntry, Code)), RCX, 2});
+                break;
+
+            case Handler_BEQ: Branch(Cond_E, op, pc);
+                break;
+            case Handler_BNE: Branch(Cond_NE, op, pc);
+                break;
+            case Handler_BLT: Branch(Cond_L, op, pc);
+                break;
+            case Handler_BGE: Branch(Cond_GE, op, pc);
+                break;
+            case Handler_BLTU: Branch(Cond_B, op, pc);
+                break;
+            case Handler_BGEU: Branch(Cond_AE, op, pc);
+                break;
+
+            // LB zero-extends like the interpreter does
+            case Handler_LB: LoadOp({0x0f, 0xb6}, op);
+                break;
+            case Handler_LH: LoadOp({0x0f, 0xbf}, op);
+                break;
+            case Handler_LW: LoadOp({0x8b}, op);
+                break;
+            case Handler_LBU: LoadOp({0x0f, 0xb6}, op);
+                break;
+            case Handler_LHU: LoadOp({0x0f, 0xb7}, op);
+                break;
+
+            case Handler_SB: StoreOp(1, op, pc, remaining);
+                break;
+            case Handler_SH: StoreOp(2, op, pc, remaining);
+                break;
+            case Handler_SW: StoreOp(4, op, pc, remaining);
+                break;
+
+            case Handler_ADDI: Binary(Alu_Add, op.Rd, op.Rs1, OpImm(op.Imm));
+                break;
+            case Handler_SLTI: Compare(Cond_L, op.Rd, op.Rs1, OpImm(op.Imm));
+                break;
+            case Handler_SLTIU: Compare(Cond_B, op.Rd, op.Rs1, OpImm(op.Imm));
+                break;
+            case Handler_XORI: Binary(Alu_Xor, op.Rd, op.Rs1, OpImm(op.Imm));
+                break;
+            case Handler_ORI: Binary(Alu_Or, op.Rd, op.Rs1, OpImm(op.Imm));
+                break;
+            case Handler_ANDI: Binary(Alu_And, op.Rd, op.Rs1, OpImm(op.Imm));
+                break;
+            case Handler_SLLI: ShiftImm(Shift_Shl, op.Rd, op.Rs1, op.Imm);
+                break;
+            // SRL and SRLI are arithmetic in the interpreter, keep it that way
+            case Handler_SRLI:
+            case Handler_SRAI: ShiftImm(Shift_Sar, op.Rd, op.Rs1, op.Imm);
+                break;
+
+            case Handler_ADD: Binary(Alu_Add, op.Rd, op.Rs1, Src(op.Rs2));
+                break;
+            case Handler_SUB: Binary(Alu_Sub, op.Rd, op.Rs1, Src(op.Rs2));
+                break;
+            case Handler_SLL: ShiftReg(Shift_Shl, op.Rd, op.Rs1, op.Rs2);
+                break;
+            case Handler_SLT: Compare(Cond_L, op.Rd, op.Rs1, Src(op.Rs2));
+                break;
+            case Handler_SLTU: Compare(Cond_B, op.Rd, op.Rs1, Src(op.Rs2));
+                break;
+            case Handler_XOR: Binary(Alu_Xor, op.Rd, op.Rs1, Src(op.Rs2));
+                break;
+            case Handler_SRL:
+            case Handler_SRA: ShiftReg(Shift_Sar, op.Rd, op.Rs1, op.Rs2);
+                break;
+            case Handler_OR: Binary(Alu_Or, op.Rd, op.Rs1, Src(op.Rs2));
+                break;
+            case Handler_AND: Binary(Alu_And, op.Rd, op.Rs1, Src(op.Rs2));
+                break;
+
+            case Handler_FENCE:
+                break;
+
+            case Handler_ECALL:
+            case Handler_EBREAK:
+                WriteBack();
+                e.MovRI(RAX, static_cast<int32_t>(pc));
+                e.MovMI(Ctx(offsetof(RiscVM::JitContext, Exit)), JitExit_Interpret);
+                e.Jmp(m_Exit);
+                break;
+
+            case Handler_MUL:
+                Get(RAX, op.Rs1);
+                e.Imul(RAX, Src(op.Rs2));
+                Put(op.Rd, RAX);
+                break;
+            // the high multiplies only look at the low halves, same as the interpreter
+            case Handler_MULH:
+            case Handler_MULHSU:
+            case Handler_MULHU:
+                Get(RAX, op.Rs1);
+                Get(RCX, op.Rs2);
+                if (op.Handler == Handler_MULHU)
+                    e.Movzx16(RAX, RAX);
+                else
+                    e.Movsx16(RAX, RAX);
+                if (op.Handler == Handler_MULH)
+                    e.Movsx16(RCX, RCX);
+                else
+                    e.Movzx16(RCX, RCX);
+                e.Imul(RAX, OpReg(RCX));
+                Put(op.Rd, RAX);
+                break;
+            case Handler_DIV:
+            case Handler_REM:
+                Get(RAX, op.Rs1);
+                Get(RCX, op.Rs2);
+                e.Cdq();
+                e.Idiv(RCX);
+                Put(op.Rd, op.Handler == Handler_DIV ? RAX : RDX);
+                break;
+            case Handler_DIVU:
+            case Handler_REMU:
+                Get(RAX, op.Rs1);
+                Get(RCX, op.Rs2);
+                e.AluOp(Alu_Xor, RDX, OpReg(RDX));
+                e.Div(RCX);
+                Put(op.Rd, op.Handler == Handler_DIVU ? RAX : RDX);
+                break;
+
+            default:
+                throw std::runtime_error("no such opcode");
+            }
+        }
+
+        void EmitStubs()
+        {
+            Emitter::Patch(m_BudgetSite, e.Ptr());
+            e.MovRI(RAX, static_cast<int32_t>(m_Begin));
+            e.Jmp(m_BudgetExit);
+
+            for (const auto& stub : m_Stubs)
+            {
+                Emitter::Patch(stub.Site, e.Ptr());
+                if (stub.Store)
+                {
+                    WriteBack();
+                    e.MovMR(Ctx(offsetof(RiscVM::JitContext, Address)), RAX);
+                    e.MovMI(Ctx(offsetof(RiscVM::JitContext, StoreSize)), static_cast<int32_t>(stub.StoreSize));
+                    if (stub.Remaining)
+                        e.AluMI(Alu_Sub, Ctx(offsetof(RiscVM::JitContext, Instructions)), static_cast<int32_t>(stub.Remaining), true);
+                    e.MovMI(Ctx(offsetof(RiscVM::JitContext, Exit)), RiscVM::JitExit_Store);
+                }
+                else
+                {
+                    e.MovAbs(RCX, reinterpret_cast<uint64_t>(stub.Site));
+                    e.MovMR(Ctx(offsetof(RiscVM::JitContext, LinkSite)), RCX, true);
+                    e.MovMI(Ctx(offsetof(RiscVM::JitContext, Exit)), RiscVM::JitExit_Jump);
+                }
+                e.MovRI(RAX, static_cast<int32_t>(stub.PC));
+                e.Jmp(m_Exit);
+            }
+        }
+
+        Emitter& e;
+        const uint8_t* m_Exit;
+        const uint8_t* m_IndirectExit;
+        const uint8_t* m_BudgetExit;
+
+        uint32_t m_Begin = 0;
+        uint8_t* m_BudgetSite = nullptr;
+        Reg m_Host[32]{};
+        bool m_Written[32]{};
+        std::vector<Stub> m_Stubs;
+    };
+}
+
+RiscVM::JIT::JIT(const size_t capacity)
+    : m_Capacity(capacity), m_Table(1 << TableBits)
+{
+    const auto base = mmap(nullptr, m_Capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        throw std::runtime_error("failed to map jit code cache");
+    m_Base = static_cast<uint8_t*>(base);
+
+    Emitter e(m_Base, m_Base + m_Capacity);
+
+    // uint32_t enter(JitContext* context, const uint8_t* code)
+    m_EnterCode = e.Ptr();
+    e.Push(RBX);
+    e.Push(RBP);
+    e.Push(R12);
+    e.Push(R13);
+    e.Push(R14);
+    e.Push(R15);
+    e.RR({0x8b}, Context, RDI, true);
+    e.MovRM(Registers, Ctx(offsetof(JitContext, Registers)), true);
+    e.MovRM(Memory, Ctx(offsetof(JitContext, Memory)), true);
+    e.JmpR(RSI);
+
+    // every exit ends up here with the next guest pc in eax
+    m_ExitCode = e.Ptr();
+    e.Pop(R15);
+    e.Pop(R14);
+    e.Pop(R13);
+    e.Pop(R12);
+    e.Pop(RBP);
+    e.Pop(RBX);
+    e.Ret();
+
+    m_IndirectExitCode = e.Ptr();
+    e.MovMI(Ctx(offsetof(JitContext, LinkSite)), 0, true);
+    e.MovMI(Ctx(offsetof(JitContext, Exit)), JitExit_Jump);
+    e.Jmp(m_ExitCode);
+
+    m_BudgetExitCode = e.Ptr();
+    e.MovMI(Ctx(offsetof(JitContext, LinkSite)), 0, true);
+    e.MovMI(Ctx(offsetof(JitContext, Exit)), JitExit_Budget);
+    e.Jmp(m_ExitCode);
+
+    m_Reserved = m_Used = e.Ptr() - m_Base;
+    Executable();
+    Reset();
+}
+
+RiscVM::JIT::~JIT()
+{
+    munmap(m_Base, m_Capacity);
+}
+
+bool RiscVM::JIT::Compile(Block& block)
+{
+    Writable();
+    Emitter e(m_Base + m_Used, m_Base + m_Capacity);
+    Compiler(e, m_ExitCode, m_IndirectExitCode, m_BudgetExitCode).Compile(block);
+    Executable();
+
+    if (e.Overflow())
+        return false;
+
+    block.Native = m_Base + m_Used;
+    m_Used = e.Ptr() - m_Base;
+    m_Incoming[&block];
+    return true;
+}
+
+uint32_t RiscVM::JIT::Enter(JitContext& context, const uint8_t* code) const
+{
+    return reinterpret_cast<uint32_t (*)(JitContext*, const uint8_t*)>(m_EnterCode)(&context, code);
+}
+
+void RiscVM::JIT::Link(uint8_t* site, Block& target)
+{
+    const auto stub = Emitter::Target(site);
+    Writable();
+    Emitter::Patch(site, target.Native);
+    Executable();
+    m_Incoming[&target].push_back({site, stub});
+}
+
+void RiscVM::JIT::Publish(const uint32_t pc, const Block& block)
+{
+    m_Table[pc >> 2 & ((1 << TableBits) - 1)] = {pc, block.Native};
+}
+
+void RiscVM::JIT::Forget(Block& block)
+{
+    const auto it = m_Incoming.find(&block);
+    if (it == m_Incoming.end())
+        return;
+
+    // the block's own code stays in the cache until the next flush, only jumps into it go
+    if (!it->second.empty())
+    {
+        Writable();
+        for (const auto& [site, stub] : it->second)
+            Emitter::Patch(site, stub);
+        Executable();
+    }
+
+    auto& entry = m_Table[block.Begin >> 2 & ((1 << TableBits) - 1)];
+    if (entry.Code == block.Native)
+        entry = {~0u, m_IndirectExitCode};
+
+    m_Incoming.erase(it);
+    block.Native = nullptr;
+}
+
+void RiscVM::JIT::Flush()
+{
+    for (const auto& block : m_Incoming | std::views::keys)
+        block->Native = nullptr;
+    m_Incoming.clear();
+    m_Used = m_Reserved;
+    Reset();
+}
+
+RiscVM::JitEntry* RiscVM::JIT::Table()
+{
+    return m_Table.data();
+}
+
+void RiscVM::JIT::Writable() const
+{
+    mprotect(m_Base, m_Capacity, PROT_READ | PROT_WRITE);
+}
+
+void RiscVM::JIT::Executable() const
+{
+    mprotect(m_Base, m_Capacity, PROT_READ | PROT_EXEC);
+}
+
+void RiscVM::JIT::Reset()
+{
+    // an empty slot never matches an aligned pc, and if a misaligned one hits it anyway it only
+    // leaves through the indirect exit
+    std::fill(m_Table.begin(), m_Table.end(), JitEntry{~0u, m_IndirectExitCode});
+}
+
+#else
+
+RiscVM::JIT::JIT(const size_t capacity)
+    : m_Capacity(capacity)
+{
+}
+
+RiscVM::JIT::~JIT() = default;
+
+bool RiscVM::JIT::Compile(Block&)
+{
+    return false;
+}
+
+uint32_t RiscVM::JIT::Enter(JitContext&, const uint8_t*) const
+{
+    return 0;
+}
+
+void RiscVM::JIT::Link(uint8_t*, Block&)
+{
+}
+
+void RiscVM::JIT::Publish(uint32_t, const Block&)
+{
+}
+
+void RiscVM::JIT::Forget(Block& block)
+{
+    block.Native = nullptr;
+}
+
+void RiscVM::JIT::Flush()
+{
+}
+
+RiscVM::JitEntry* RiscVM::JIT::Table()
+{
+    return nullptr;
+}
+
+void RiscVM::JIT::Writable() const
+{
+}
+
+void RiscVM::JIT::Executable() const
+{
+}
+
+void RiscVM::JIT::Reset()
+{
+}
+
+#endif
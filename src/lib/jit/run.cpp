@@ -0,0 +1,107 @@
+#include <RiscVM/JIT.hpp>
+#include <RiscVM/VM.hpp>
+
+#if RISCVM_HAS_JIT
+
+void RiscVM::VM::RunJIT()
+{
+    if (!m_Ok)
+        return;
+
+    if (!m_JIT)
+        m_JIT = std::make_unique<JIT>();
+
+    CollectBlocks();
+
+    JitContext context{};
+    context.Registers = m_Registers;
+    context.Table = m_JIT->Table();
+
+    auto pc = static_cast<uint32_t>(m_PC);
+    uint8_t* site = nullptr;
+
+    // compiled blocks jump into each other directly once linked, so this loop only runs when
+    // a block exits through a jump that is not linked yet, a store into code, an ECALL or the
+    // end of the budget
+    while (true)
+    {
+        m_PC = static_cast<int32_t>(pc);
+        if (pc >= m_MemorySize || pc & 0b11)
+        {
+            Fault();
+            return;
+        }
+        if (m_Instructions >= m_Deadline)
+            return;
+
+        if (m_RetiredBlocks.size() > 64)
+            CollectBlocks();
+
+        const auto block = FindBlock(pc);
+        if (!block)
+        {
+            Fault();
+            return;
+        }
+        if (!block->Native && ++block->Heat >= JIT::Threshold && !m_JIT->Compile(*block))
+        {
+            m_JIT->Flush();
+            site = nullptr;
+            m_JIT->Compile(*block);
+        }
+
+        if (!block->Native)
+        {
+            for (uint32_t i = 0; i < block->Size; ++i)
+                if (!Cycle())
+                    return;
+            if (!m_Ok || m_Pause)
+                return;
+            pc = static_cast<uint32_t>(m_PC);
+            site = nullptr;
+            continue;
+        }
+
+        if (site)
+            m_JIT->Link(site, *block);
+        else
+            m_JIT->Publish(pc, *block);
+
+        context.Memory = m_Memory;
+        context.Ops = m_Ops;
+        context.Instructions = 0;
+        context.Budget = m_Deadline - m_Instructions;
+        pc = m_JIT->Enter(context, block->Native);
+        m_Instructions += context.Instructions;
+
+        site = nullptr;
+        switch (context.Exit)
+        {
+        case JitExit_Jump:
+            site = context.LinkSite;
+            break;
+        case JitExit_Store:
+            Invalidate(context.Address);
+            Invalidate(context.Address + context.StoreSize - 1);
+            break;
+        case JitExit_Interpret:
+            m_PC = static_cast<int32_t>(pc);
+            if (!Cycle() || !m_Ok || m_Pause)
+                return;
+            pc = static_cast<uint32_t>(m_PC);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+#else
+
+void RiscVM::VM::RunJIT()
+{
+    // no code generator for this host, the block engine is the closest tier
+    RunBlocks();
+}
+
+#endif
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+// a minimal x86-64 encoder covering exactly what the block compiler emits. every memory operand
+// is encoded with a 32-bit displacement, which keeps the encoding uniform for all base registers.
+
+namespace RiscVM::X64
+{
+    enum Reg : uint8_t
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15,
+        NoReg = 0xff,
+    };
+
+    enum Cond : uint8_t
+    {
+        Cond_B = 0x2,
+        Cond_AE = 0x3,
+        Cond_E = 0x4,
+        Cond_NE = 0x5,
+        Cond_L = 0xc,
+        Cond_GE = 0xd,
+    };
+
+    enum Alu : uint8_t
+    {
+        Alu_Add = 0,
+        Alu_Or = 1,
+        Alu_And = 4,
+        Alu_Sub = 5,
+        Alu_Xor = 6,
+        Alu_Cmp = 7,
+    };
+
+    enum Shift : uint8_t
+    {
+        Shift_Shl = 4,
+        Shift_Shr = 5,
+        Shift_Sar = 7,
+    };
+
+    struct Mem
+    {
+        Reg Base;
+        int32_t Disp = 0;
+        Reg Index = NoReg;
+        uint8_t Scale = 0;
+    };
+
+    /**
+     * A source operand: a register, a memory location or an immediate.
+     */
+    struct Operand
+    {
+        enum { Kind_Reg, Kind_Mem, Kind_Imm } Kind;
+        Reg R = NoReg;
+        Mem M{};
+        int32_t Imm = 0;
+    };
+
+    class Emitter
+    {
+    public:
+        Emitter(uint8_t* begin, uint8_t* end)
+            : m_Ptr(begin), m_End(end)
+        {
+        }
+
+        [[nodiscard]] uint8_t* Ptr() const { return m_Ptr; }
+        [[nodiscard]] bool Overflow() const { return m_Overflow; }
+
+        void Byte(const uint8_t b)
+        {
+            if (m_Ptr >= m_End)
+            {
+                m_Overflow = true;
+                return;
+            }
+            *m_Ptr++ = b;
+        }
+
+        void Dword(const uint32_t d)
+        {
+            for (unsigned i = 0; i < 4; ++i)
+                Byte(d >> i * 8);
+        }
+
+        void Qword(const uint64_t q)
+        {
+            for (unsigned i = 0; i < 8; ++i)
+                Byte(q >> i * 8);
+        }
+
+        void Rex(const bool w, const unsigned reg, const unsigned index, const unsigned base)
+        {
+            const uint8_t rex = 0x40 | w << 3 | (reg >> 3 & 1) << 2 | (index >> 3 & 1) << 1 | (base >> 3 & 1);
+            if (rex != 0x40)
+                Byte(rex);
+        }
+
+        // <opcode> reg, r/m with a register r/m
+        void RR(const std::initializer_list<uint8_t> opcode, const unsigned reg, const unsigned rm, const bool w = false)
+        {
+            Rex(w, reg, 0, rm);
+            for (const auto b : opcode)
+                Byte(b);
+            Byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+        }
+
+        // <opcode> reg, r/m with a memory r/m
+        void RM(const std::initializer_list<uint8_t> opcode, const unsigned reg, const Mem& m, const bool w = false)
+        {
+            const unsigned index = m.Index == NoReg ? 0 : m.Index;
+            Rex(w, reg, index, m.Base);
+            for (const auto b : opcode)
+                Byte(b);
+            if (m.Index != NoReg)
+            {
+                Byte(0x80 | (reg & 7) << 3 | 4);
+                Byte(m.Scale << 6 | (index & 7) << 3 | (m.Base & 7));
+            }
+            else
+            {
+                Byte(0x80 | (reg & 7) << 3 | (m.Base & 7));
+                if ((m.Base & 7) == RSP)
+                    Byte(0x24);
+            }
+            Dword(m.Disp);
+        }
+
+        void Op(const std::initializer_list<uint8_t> opcode, const unsigned reg, const Operand& rm, const bool w = false)
+        {
+            if (rm.Kind == Operand::Kind_Reg)
+                RR(opcode, reg, rm.R, w);
+            else
+                RM(opcode, reg, rm.M, w);
+        }
+
+        void MovRR(const Reg dst, const Reg src)
+        {
+            if (dst != src)
+                RR({0x8b}, dst, src);
+        }
+
+        void MovRI(const Reg dst, const int32_t imm)
+        {
+            Rex(false, 0, 0, dst);
+            Byte(0xb8 | (dst & 7));
+            Dword(imm);
+        }
+
+        void MovRM(const Reg dst, const Mem& m, const bool w = false) { RM({0x8b}, dst, m, w); }
+        void MovMR(const Mem& m, const Reg src, const bool w = false) { RM({0x89}, src, m, w); }
+
+        void MovMI(const Mem& m, const int32_t imm, const bool w = false)
+        {
+            RM({0xc7}, 0, m, w);
+            Dword(imm);
+        }
+
+        // mov reg, <operand>
+        void Load(const Reg dst, const Operand& src)
+        {
+            switch (src.Kind)
+            {
+            case Operand::Kind_Reg:
+                MovRR(dst, src.R);
+                break;
+            case Operand::Kind_Mem:
+                MovRM(dst, src.M);
+                break;
+            case Operand::Kind_Imm:
+                MovRI(dst, src.Imm);
+                break;
+            }
+        }
+
+        void MovAbs(const Reg dst, const uint64_t imm)
+        {
+            Rex(true, 0, 0, dst);
+            Byte(0xb8 | (dst & 7));
+            Qword(imm);
+        }
+
+        void Movsxd(const Reg dst, const Reg src) { RR({0x63}, dst, src, true); }
+
+        void AluOp(const Alu alu, const Reg dst, const Operand& src)
+        {
+            if (src.Kind != Operand::Kind_Imm)
+                return Op({static_cast<uint8_t>(alu << 3 | 3)}, dst, src);
+            if (src.Imm >= -128 && src.Imm <= 127)
+            {
+                RR({0x83}, alu, dst);
+                Byte(src.Imm);
+                return;
+            }
+            RR({0x81}, alu, dst);
+            Dword(src.Imm);
+        }
+
+        void AluMI(const Alu alu, const Mem& m, const int32_t imm, const bool w = false)
+        {
+            RM({0x81}, alu, m, w);
+            Dword(imm);
+        }
+
+        void ShiftRI(const Shift shift, const Reg dst, const uint8_t imm)
+        {
+            RR({0xc1}, shift, dst);
+            Byte(imm);
+        }
+
+        void ShiftRCl(const Shift shift, const Reg dst) { RR({0xd3}, shift, dst); }
+
+        void Imul(const Reg dst, const Operand& src)
+        {
+            if (src.Kind != Operand::Kind_Imm)
+                return Op({0x0f, 0xaf}, dst, src);
+            RR({0x69}, dst, dst);
+            Dword(src.Imm);
+        }
+        void Movsx16(const Reg dst, const Reg src) { RR({0x0f, 0xbf}, dst, src); }
+        void Movzx16(const Reg dst, const Reg src) { RR({0x0f, 0xb7}, dst, src); }
+
+        // setcc al; movzx eax, al
+        void SetRax(const Cond cond)
+        {
+            Byte(0x0f);
+            Byte(0x90 | cond);
+            Byte(0xc0);
+            RR({0x0f, 0xb6}, RAX, RAX);
+        }
+
+        void Cdq() { Byte(0x99); }
+        void Idiv(const Reg src) { RR({0xf7}, 7, src); }
+        void Div(const Reg src) { RR({0xf7}, 6, src); }
+
+        void Lea(const Reg dst, const Mem& m) { RM({0x8d}, dst, m); }
+
+        void CmpMI8(const Mem& m, const int8_t imm)
+        {
+            RM({0x80}, Alu_Cmp, m);
+            Byte(imm);
+        }
+
+        // returns the rel32 field, for Patch()
+        uint8_t* Jmp(const uint8_t* target)
+        {
+            Byte(0xe9);
+            return Rel32(target);
+        }
+
+        uint8_t* Jcc(const Cond cond, const uint8_t* target)
+        {
+            Byte(0x0f);
+            Byte(0x80 | cond);
+            return Rel32(target);
+        }
+
+        void JmpR(const Reg target) { RR({0xff}, 4, target); }
+        void JmpM(const Mem& m) { RM({0xff}, 4, m); }
+
+        void Push(const Reg r)
+        {
+            Rex(false, 0, 0, r);
+            Byte(0x50 | (r & 7));
+        }
+
+        void Pop(const Reg r)
+        {
+            Rex(false, 0, 0, r);
+            Byte(0x58 | (r & 7));
+        }
+
+        void Ret() { Byte(0xc3); }
+
+        static void Patch(uint8_t* site, const uint8_t* target)
+        {
+            const auto rel = static_cast<int32_t>(target - (site + 4));
+            memcpy(site, &rel, sizeof(rel));
+        }
+
+        static uint8_t* Target(const uint8_t* site)
+        {
+            int32_t rel;
+            memcpy(&rel, site, sizeof(rel));
+            return const_cast<uint8_t*>(site) + 4 + rel;
+        }
+
+    private:
+        uint8_t* Rel32(const uint8_t* target)
+        {
+            const auto site = m_Ptr;
+            Dword(0);
+            if (!m_Overflow && target)
+                Patch(site, target);
+            return site;
+        }
+
+        uint8_t* m_Ptr;
+        uint8_t* m_End;
+        bool m_Overflow = false;
+    };
+}
@@ -0,0 +1,11 @@
+// label table of the computed-goto engines, in Handler order
+&&op_Invalid,
+&&op_LUI, &&op_AUIPC, &&op_JAL, &&op_JALR,
+&&op_BEQ, &&op_BNE, &&op_BLT, &&op_BGE, &&op_BLTU, &&op_BGEU,
+&&op_LB, &&op_LH, &&op_LW, &&op_LBU, &&op_LHU,
+&&op_SB, &&op_SH, &&op_SW,
+&&op_ADDI, &&op_SLTI, &&op_SLTIU, &&op_XORI, &&op_ORI, &&op_ANDI, &&op_SLLI, &&op_SRLI, &&op_SRAI,
+&&op_ADD, &&op_SUB, &&op_SLL, &&op_SLT, &&op_SLTU, &&op_XOR, &&op_SRL, &&op_SRA, &&op_OR, &&op_AND,
+&&op_FENCE, &&op_ECALL, &&op_EBREAK,
+&&op_MUL, &&op_MULH, &&op_MULHSU, &&op_MULHU, &&op_DIV, &&op_DIVU, &&op_REM, &&op_REMU,
+&&op_LA, &&op_LI, &&op_CALL, &&op_PUSH, &&op_POP,
@@ -0,0 +1,433 @@
+#include <cstring>
+#include <limits>
+#include <RiscVM/ISA.hpp>
+#include <RiscVM/Lockstep.hpp>
+
+namespace
+{
+    constexpr auto Lanes = RiscVM::Lockstep::Lanes;
+
+    // dst = f(lane) in the lanes of mask. the values are computed for every lane first so the
+    // loops stay branch-free and vectorize; f must therefore be safe on lanes outside the group
+    template <typename F>
+    void Map(int32_t* dst, const int32_t* mask, F f)
+    {
+        int32_t v[Lanes];
+        for (uint32_t l = 0; l < Lanes; ++l)
+            v[l] = f(l);
+        for (uint32_t l = 0; l < Lanes; ++l)
+            dst[l] = mask[l] ? v[l] : dst[l];
+    }
+
+    // pc = cond(lane) ? from + imm : from + 4 in the lanes of mask
+    template <typename F>
+    void Branch(uint32_t* pc, const int32_t* mask, const uint32_t from, const int32_t imm, F cond)
+    {
+        for (uint32_t l = 0; l < Lanes; ++l)
+        {
+            const auto next = from + (cond(l) ? imm : 4);
+            pc[l] = mask[l] ? next : pc[l];
+        }
+    }
+
+    // divisors of lanes outside the group are whatever they hold, keep them from trapping
+    int32_t Divisor(const int32_t mask, const int32_t value)
+    {
+        return mask ? value : 1;
+    }
+}
+
+RiscVM::Lockstep::Lockstep(const ECallTable& ecall_map)
+{
+    for (auto& lane : m_Lanes)
+    {
+        lane = std::make_unique<VM>();
+        lane->ECallMap() = ecall_map;
+    }
+}
+
+void RiscVM::Lockstep::Load(const char* pgm, const size_t len)
+{
+    m_Image.assign(pgm, pgm + len);
+
+    // decoded once for all lanes and left unfused, so every op is a single instruction
+    m_Ops.assign((len >> 2) + 1, {});
+    for (size_t i = 0; i + 4 <= len; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, pgm + i, sizeof(word));
+        m_Ops[i >> 2] = Decode(word);
+    }
+
+    Reset();
+}
+
+void RiscVM::Lockstep::Reset()
+{
+    memset(m_Registers, 0, sizeof(m_Registers));
+    for (uint32_t l = 0; l < Lanes; ++l)
+    {
+        auto& lane = *m_Lanes[l];
+        lane.Load(m_Image.data(), m_Image.size());
+        lane.Reset();
+        lane.Status() = 0;
+
+        m_PC[l] = 0;
+        m_Live[l] = true;
+        m_Stop[l] = Stop_Exit;
+        m_Instructions[l] = 0;
+    }
+    m_Steps = 0;
+    Regroup();
+}
+
+RiscVM::StopReason RiscVM::Lockstep::Run(const uint64_t max_steps)
+{
+    // lanes that paused go on past the instruction that paused them
+    bool resumed = false;
+    for (uint32_t l = 0; l < Lanes; ++l)
+    {
+        if (m_Live[l] || (m_Stop[l] != Stop_Breakpoint && m_Stop[l] != Stop_Yield))
+            continue;
+        m_Live[l] = true;
+        resumed = true;
+    }
+    if (resumed)
+        Regroup();
+
+    // Regroup() parks the group pc at the maximum once no lane is left
+    constexpr auto none = std::numeric_limits<uint32_t>::max();
+    m_Pause = Stop_Budget;
+    uint64_t step = 0;
+    for (; step < max_steps && m_GroupPC != none && m_Pause == Stop_Budget; ++step)
+    {
+        ++m_Run;
+        Exec(m_Ops[m_GroupPC >> 2]);
+    }
+
+    m_Steps += step;
+    Sync();
+    if (m_Pause != Stop_Budget)
+        return m_Pause;
+    return m_GroupPC == none ? Stop_Exit : Stop_Budget;
+}
+
+int32_t& RiscVM::Lockstep::R(const uint32_t lane, const uint32_t r)
+{
+    if (r == 0)
+    {
+        m_Registers[RegisterSink][lane] = 0;
+        return m_Registers[RegisterSink][lane];
+    }
+    return m_Registers[r][lane];
+}
+
+uint32_t& RiscVM::Lockstep::PC(const uint32_t lane)
+{
+    return m_PC[lane];
+}
+
+RiscVM::VM& RiscVM::Lockstep::Lane(const uint32_t lane)
+{
+    return *m_Lanes[lane];
+}
+
+RiscVM::StopReason RiscVM::Lockstep::Reason(const uint32_t lane) const
+{
+    return m_Live[lane] ? Stop_Budget : m_Stop[lane];
+}
+
+int32_t RiscVM::Lockstep::Status(const uint32_t lane) const
+{
+    return m_Lanes[lane]->Status();
+}
+
+uint64_t RiscVM::Lockstep::Instructions(const uint32_t lane) const
+{
+    return m_Instructions[lane];
+}
+
+uint64_t RiscVM::Lockstep::Steps() const
+{
+    return m_Steps;
+}
+
+bool RiscVM::Lockstep::Runnable(const uint32_t pc) const
+{
+    return pc < m_Image.size() && !(pc & 0b11) && m_Ops[pc >> 2].Handler != Handler_Invalid;
+}
+
+void RiscVM::Lockstep::Sync()
+{
+    for (uint32_t l = 0; l < Lanes; ++l)
+    {
+        m_PC[l] = m_Mask[l] ? m_GroupPC : m_PC[l];
+        m_Instructions[l] += m_Mask[l] ? m_Run : 0;
+    }
+    m_Run = 0;
+}
+
+void RiscVM::Lockstep::Regroup()
+{
+    for (uint32_t l = 0; l < Lanes; ++l)
+        m_Instructions[l] += m_Mask[l] ? m_Run : 0;
+    m_Run = 0;
+
+    // lanes that jumped somewhere they cannot run stop here, before they could lead a group
+    for (uint32_t l = 0; l < Lanes; ++l)
+        if (m_Live[l] && !Runnable(m_PC[l]))
+            Stop(l, Stop_Fault);
+
+    constexpr auto none = std::numeric_limits<uint32_t>::max();
+    auto pc = none;
+    for (uint32_t l = 0; l < Lanes; ++l)
+        if (m_Live[l] && m_PC[l] < pc)
+        {
+            pc = m_PC[l];
+            m_Lead = l;
+        }
+
+    m_GroupPC = pc;
+    m_NextPC = none;
+    for (uint32_t l = 0; l < Lanes; ++l)
+    {
+        m_Mask[l] = m_Live[l] && m_PC[l] == pc ? -1 : 0;
+        if (m_Live[l] && m_PC[l] != pc && m_PC[l] < m_NextPC)
+            m_NextPC = m_PC[l];
+    }
+}
+
+void RiscVM::Lockstep::Follow()
+{
+    // a group holding every live lane usually stays whole, e.g. at a call or at a loop branch
+    // all lanes agree on
+    if (m_NextPC == std::numeric_limits<uint32_t>::max())
+    {
+        const auto pc = m_PC[m_Lead];
+        bool uniform = true;
+        for (uint32_t l = 0; l < Lanes; ++l)
+            uniform &= !m_Live[l] || m_PC[l] == pc;
+        if (uniform && Runnable(pc))
+        {
+            m_GroupPC = pc;
+            return;
+        }
+    }
+    Regroup();
+}
+
+void RiscVM::Lockstep::Advance()
+{
+    // the group moves on together; it splits up again once it catches up with a lane parked
+    // ahead or runs into something it cannot execute
+    m_GroupPC += 4;
+    if (m_GroupPC == m_NextPC || m_Ops[m_GroupPC >> 2].Handler == Handler_Invalid)
+    {
+        Sync();
+        Regroup();
+    }
+}
+
+void RiscVM::Lockstep::Stop(const uint32_t lane, const StopReason reason)
+{
+    m_Instructions[lane] += m_Mask[lane] ? m_Run : 0;
+    m_Live[lane] = false;
+    m_Stop[lane] = reason;
+    m_Mask[lane] = 0;
+}
+
+void RiscVM::Lockstep::Exec(const Op& op)
+{
+    const int32_t* m = m_Mask;
+    int32_t* d = m_Registers[op.Rd];
+    const int32_t* a = m_Registers[op.Rs1];
+    const int32_t* b = m_Registers[op.Rs2];
+    const auto imm = op.Imm;
+    const auto pc = static_cast<int32_t>(m_GroupPC);
+
+    // the same arithmetic as handlers.inl, so every lane computes what a lone VM would
+    switch (op.Handler)
+    {
+    case Handler_LUI: Map(d, m, [&](uint32_t) { return imm; }); break;
+    case Handler_AUIPC: Map(d, m, [&](uint32_t) { return imm + pc; }); break;
+
+    case Handler_JAL:
+        Map(d, m, [&](uint32_t) { return pc + 4; });
+        for (uint32_t l = 0; l < Lanes; ++l)
+            m_PC[l] = m[l] ? pc + imm : m_PC[l];
+        Follow();
+        return;
+    case Handler_JALR:
+        {
+            uint32_t target[Lanes];
+            for (uint32_t l = 0; l < Lanes; ++l)
+                target[l] = a[l] + imm;
+            Map(d, m, [&](uint32_t) { return pc + 4; });
+            for (uint32_t l = 0; l < Lanes; ++l)
+                m_PC[l] = m[l] ? target[l] : m_PC[l];
+        }
+        Follow();
+        return;
+
+    case Handler_BEQ: Branch(m_PC, m, m_GroupPC, imm, [&](uint32_t l) { return a[l] == b[l]; }); Follow(); return;
+    case Handler_BNE: Branch(m_PC, m, m_GroupPC, imm, [&](uint32_t l) { return a[l] != b[l]; }); Follow(); return;
+    case Handler_BLT: Branch(m_PC, m, m_GroupPC, imm, [&](uint32_t l) { return a[l] < b[l]; }); Follow(); return;
+    case Handler_BGE: Branch(m_PC, m, m_GroupPC, imm, [&](uint32_t l) { return a[l] >= b[l]; }); Follow(); return;
+    case Handler_BLTU:
+        Branch(m_PC, m, m_GroupPC, imm, [&](uint32_t l) { return static_cast<uint32_t>(a[l]) < static_cast<uint32_t>(b[l]); });
+        Follow();
+        return;
+    case Handler_BGEU:
+        Branch(m_PC, m, m_GroupPC, imm, [&](uint32_t l) { return static_cast<uint32_t>(a[l]) >= static_cast<uint32_t>(b[l]); });
+        Follow();
+        return;
+
+    case Handler_LB:
+    case Handler_LH:
+    case Handler_LW:
+    case Handler_LBU:
+    case Handler_LHU:
+        for (uint32_t l = 0; l < Lanes; ++l)
+        {
+            if (!m[l])
+                continue;
+            const char* mem = &m_Lanes[l]->Memory()[a[l] + imm];
+            switch (op.Handler)
+            {
+            case Handler_LB: d[l] = static_cast<uint8_t>(*reinterpret_cast<const int8_t*>(mem)); break;
+            case Handler_LH: d[l] = *reinterpret_cast<const int16_t*>(mem); break;
+            case Handler_LW: d[l] = *reinterpret_cast<const int32_t*>(mem); break;
+            case Handler_LBU: d[l] = *reinterpret_cast<const uint8_t*>(mem); break;
+            default: d[l] = *reinterpret_cast<const uint16_t*>(mem); break;
+            }
+        }
+        break;
+    case Handler_SB:
+    case Handler_SH:
+    case Handler_SW:
+        for (uint32_t l = 0; l < Lanes; ++l)
+        {
+            if (!m[l])
+                continue;
+            char* mem = &m_Lanes[l]->Memory()[b[l] + imm];
+            switch (op.Handler)
+            {
+            case Handler_SB: *reinterpret_cast<int8_t*>(mem) = static_cast<int8_t>(a[l]); break;
+            case Handler_SH: *reinterpret_cast<int16_t*>(mem) = static_cast<int16_t>(a[l]); break;
+            default: *reinterpret_cast<int32_t*>(mem) = a[l]; break;
+            }
+        }
+        break;
+
+    case Handler_ADDI: Map(d, m, [&](uint32_t l) { return a[l] + imm; }); break;
+    case Handler_SLTI: Map(d, m, [&](uint32_t l) { return static_cast<int32_t>(a[l] < imm); }); break;
+    case Handler_SLTIU:
+        Map(d, m, [&](uint32_t l) { return static_cast<int32_t>(static_cast<uint32_t>(a[l]) < static_cast<uint32_t>(imm)); });
+        break;
+    case Handler_XORI: Map(d, m, [&](uint32_t l) { return a[l] ^ imm; }); break;
+    case Handler_ORI: Map(d, m, [&](uint32_t l) { return a[l] | imm; }); break;
+    case Handler_ANDI: Map(d, m, [&](uint32_t l) { return a[l] & imm; }); break;
+    case Handler_SLLI: Map(d, m, [&](uint32_t l) { return a[l] << imm; }); break;
+    case Handler_SRLI:
+    case Handler_SRAI: Map(d, m, [&](uint32_t l) { return a[l] >> imm; }); break;
+
+    case Handler_ADD: Map(d, m, [&](uint32_t l) { return a[l] + b[l]; }); break;
+    case Handler_SUB: Map(d, m, [&](uint32_t l) { return a[l] - b[l]; }); break;
+    case Handler_SLL: Map(d, m, [&](uint32_t l) { return a[l] << (b[l] & 31); }); break;
+    case Handler_SLT: Map(d, m, [&](uint32_t l) { return static_cast<int32_t>(a[l] < b[l]); }); break;
+    case Handler_SLTU:
+        Map(d, m, [&](uint32_t l) { return static_cast<int32_t>(static_cast<uint32_t>(a[l]) < static_cast<uint32_t>(b[l])); });
+        break;
+    case Handler_XOR: Map(d, m, [&](uint32_t l) { return a[l] ^ b[l]; }); break;
+    case Handler_SRL:
+    case Handler_SRA: Map(d, m, [&](uint32_t l) { return a[l] >> (b[l] & 31); }); break;
+    case Handler_OR: Map(d, m, [&](uint32_t l) { return a[l] | b[l]; }); break;
+    case Handler_AND: Map(d, m, [&](uint32_t l) { return a[l] & b[l]; }); break;
+
+    case Handler_FENCE:
+        break;
+    case Handler_EBREAK:
+        for (uint32_t l = 0; l < Lanes; ++l)
+        {
+            if (!m[l])
+                continue;
+            m_PC[l] = m_GroupPC + 4;
+            Stop(l, Stop_Breakpoint);
+        }
+        m_Pause = Stop_Breakpoint;
+        Regroup();
+        return;
+
+    case Handler_ECALL:
+        {
+            bool stopped = false;
+            for (uint32_t l = 0; l < Lanes; ++l)
+            {
+                if (!m[l])
+                    continue;
+
+                auto& vm = *m_Lanes[l];
+                for (uint32_t r = 1; r < 32; ++r)
+                    vm.R(r) = m_Registers[r][l];
+                vm.PC() = pc;
+                vm.m_Pause = false;
+                const auto handled = vm.ECallMap().Call(vm, m_Registers[a7][l]);
+                for (uint32_t r = 1; r < 32; ++r)
+                    m_Registers[r][l] = vm.R(r);
+
+                // a lone VM leaves a handled ecall behind whether it exits, yields or goes on
+                if (handled)
+                    m_PC[l] = m_GroupPC + 4;
+                if (!handled || !vm.Ok())
+                {
+                    Stop(l, handled ? Stop_Exit : Stop_Fault);
+                    stopped = true;
+                }
+                else if (vm.m_Pause)
+                {
+                    Stop(l, Stop_Yield);
+                    m_Pause = Stop_Yield;
+                    stopped = true;
+                }
+            }
+
+            if (!stopped)
+                break;
+            m_GroupPC += 4;
+            Sync();
+            Regroup();
+        }
+        return;
+
+    case Handler_MUL: Map(d, m, [&](uint32_t l) { return a[l] * b[l]; }); break;
+    case Handler_MULH:
+        Map(d, m, [&](uint32_t l) { return static_cast<int16_t>(a[l]) * static_cast<int16_t>(b[l]); });
+        break;
+    case Handler_MULHSU:
+        Map(d, m, [&](uint32_t l) { return static_cast<int16_t>(a[l]) * static_cast<uint16_t>(b[l]); });
+        break;
+    case Handler_MULHU:
+        Map(d, m, [&](uint32_t l) { return static_cast<uint16_t>(a[l]) * static_cast<uint16_t>(b[l]); });
+        break;
+    case Handler_DIV: Map(d, m, [&](uint32_t l) { return a[l] / Divisor(m[l], b[l]); }); break;
+    case Handler_DIVU:
+        Map(d, m, [&](uint32_t l)
+        {
+            return static_cast<int32_t>(static_cast<uint32_t>(a[l]) / static_cast<uint32_t>(Divisor(m[l], b[l])));
+        });
+        break;
+    case Handler_REM: Map(d, m, [&](uint32_t l) { return a[l] % Divisor(m[l], b[l]); }); break;
+    case Handler_REMU:
+        Map(d, m, [&](uint32_t l)
+        {
+            return static_cast<int32_t>(static_cast<uint32_t>(a[l]) % static_cast<uint32_t>(Divisor(m[l], b[l])));
+        });
+        break;
+
+    default:
+        // Regroup() never lets a group reach an undecodable op
+        break;
+    }
+
+    Advance();
+}
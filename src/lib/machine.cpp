@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cstring>
+#include <RiscVM/ISA.hpp>
+#include <RiscVM/Machine.hpp>
+
+RiscVM::Machine::Machine(const uint32_t harts)
+    : m_Slots(harts)
+{
+    for (uint32_t i = 0; i < harts; ++i)
+    {
+        m_Slots[i].Hart = std::make_unique<VM>();
+        m_Slots[i].Hart->HartId() = i;
+    }
+}
+
+RiscVM::Machine::~Machine()
+{
+    Wait();
+}
+
+void RiscVM::Machine::Load(const char* pgm, const size_t len, const size_t memory_size)
+{
+    Wait();
+    m_MemorySize = std::max(len, memory_size);
+    m_Memory = std::make_unique<char[]>(m_MemorySize);
+    memcpy(m_Memory.get(), pgm, len);
+    for (const auto& slot : m_Slots)
+        slot.Hart->Attach(m_Memory.get(), m_MemorySize);
+}
+
+bool RiscVM::Machine::Start(const uint32_t hart, const uint32_t pc, const int32_t arg)
+{
+    if (hart >= m_Slots.size())
+        return false;
+
+    std::thread finished;
+    {
+        std::lock_guard lock(m_Mutex);
+        auto& slot = m_Slots[hart];
+        if (slot.Running)
+            return false;
+        finished = std::move(slot.Thread);
+
+        auto& vm = *slot.Hart;
+        vm.Reset();
+        vm.PC() = static_cast<int32_t>(pc);
+        vm.ActiveEngine() = m_Engine;
+        vm.R<a0>() = static_cast<int32_t>(hart);
+        vm.R<a1>() = arg;
+
+        auto& ecall_map = vm.ECallMap();
+        ecall_map = m_ECallMap;
+        ecall_map.Set(ECall_HartId, [](VM& vm_)
+        {
+            vm_.R<a0>() = static_cast<int32_t>(vm_.HartId());
+        });
+        ecall_map.Set(ECall_HartStart, [this](VM& vm_)
+        {
+            const auto started = Start(vm_.R<a0>(), vm_.R<a1>(), vm_.R<a2>());
+            vm_.R<a0>() = started ? 0 : -1;
+        });
+
+        slot.Running = true;
+        slot.Thread = std::thread(&Machine::Exec, this, std::ref(slot));
+    }
+
+    // the hart's previous thread has already left Exec, this only reaps it
+    if (finished.joinable())
+        finished.join();
+    return true;
+}
+
+void RiscVM::Machine::Wait()
+{
+    while (true)
+    {
+        std::thread thread;
+        {
+            std::lock_guard lock(m_Mutex);
+            for (auto& slot : m_Slots)
+                if (slot.Thread.joinable())
+                {
+                    thread = std::move(slot.Thread);
+                    break;
+                }
+        }
+        if (!thread.joinable())
+            return;
+        thread.join();
+    }
+}
+
+int32_t RiscVM::Machine::Run()
+{
+    Start(0, 0);
+    Wait();
+    return m_Slots[0].Hart->Status();
+}
+
+uint32_t RiscVM::Machine::Harts() const
+{
+    return static_cast<uint32_t>(m_Slots.size());
+}
+
+uint64_t RiscVM::Machine::Instructions() const
+{
+    uint64_t n = 0;
+    for (const auto& slot : m_Slots)
+        n += slot.Hart->Instructions();
+    return n;
+}
+
+char* RiscVM::Machine::Memory() const
+{
+    return m_Memory.get();
+}
+
+size_t RiscVM::Machine::MemorySize() const
+{
+    return m_MemorySize;
+}
+
+RiscVM::VM& RiscVM::Machine::Hart(const uint32_t hart)
+{
+    return *m_Slots[hart].Hart;
+}
+
+RiscVM::Engine& RiscVM::Machine::ActiveEngine()
+{
+    return m_Engine;
+}
+
+RiscVM::ECallTable& RiscVM::Machine::ECallMap()
+{
+    return m_ECallMap;
+}
+
+void RiscVM::Machine::Exec(Slot& slot)
+{
+    auto& vm = *slot.Hart;
+    try
+    {
+        auto reason = vm.Run();
+        while (reason == Stop_Yield || reason == Stop_Breakpoint)
+            reason = vm.Run();
+    }
+    catch (...)
+    {
+        // an exception out of a handler would end the process on a hart thread
+        vm.Fault();
+    }
+    slot.Running = false;
+}
@@ -0,0 +1,817 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <RiscVM/VM.hpp>
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <csetjmp>
+#include <fcntl.h>
+#include <mutex>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace
+{
+    // where the SIGSEGV handler finds the write log of every tracked memory. a slot is free
+    // while Begin is null, and filled in before Begin is published. the handler only reads,
+    // so it needs no lock
+    struct TrackedMemory
+    {
+        std::atomic<char*> Begin;
+        size_t Size;
+        size_t PageSize;
+        uint8_t* Map;
+        uint32_t* Log;
+        size_t* Count;
+        // where the pages written while the VM watches go, see VM::Watch()
+        const bool* Watching;
+        uint32_t* Watched;
+        char* Before;
+        size_t* WatchCount;
+    };
+
+    constexpr size_t MaxTracked = 1 << 16;
+    TrackedMemory tracked[MaxTracked];
+    size_t tracked_end = 0;
+    std::mutex tracked_mutex;
+
+    // the slots by address, so the handler finds a memory without walking every slot: one entry
+    // per 2 MiB chunk a memory covers, holding the chunk number plus one above the slot. small
+    // memories may share a chunk, so a lookup checks each entry of its chunk until it reaches an
+    // empty one. entries change under tracked_mutex, and a removed one stays a tombstone until
+    // the entry after it is empty, so no chain a lookup may be following breaks
+    constexpr unsigned ChunkBits = 21;
+    constexpr unsigned SlotBits = 16;
+    constexpr unsigned IndexBits = 18;
+    constexpr size_t IndexSize = size_t{1} << IndexBits;
+    constexpr uint64_t Tombstone = ~uint64_t{0};
+    static_assert(MaxTracked <= size_t{1} << SlotBits);
+    std::atomic<uint64_t> tracked_index[IndexSize];
+    // entries that are not empty, tombstones included. kept below half the index
+    size_t tracked_used = 0;
+
+    size_t IndexOf(const uint64_t chunk)
+    {
+        return static_cast<size_t>(chunk * 0x9e3779b97f4a7c15 >> (64 - IndexBits));
+    }
+
+    std::pair<uint64_t, uint64_t> Chunks(const char* begin, const size_t size)
+    {
+        const auto address = reinterpret_cast<uintptr_t>(begin);
+        return {address >> ChunkBits, (address + size - 1) >> ChunkBits};
+    }
+
+    bool Index(const char* begin, const size_t size, const size_t slot)
+    {
+        const auto [first, last] = Chunks(begin, size);
+        if (tracked_used + (last - first + 1) > IndexSize / 2)
+            return false;
+
+        for (auto chunk = first; chunk <= last; ++chunk)
+        {
+            auto i = IndexOf(chunk);
+            for (uint64_t entry; (entry = tracked_index[i].load(std::memory_order_relaxed)) && entry != Tombstone;)
+                i = (i + 1) & (IndexSize - 1);
+            if (!tracked_index[i].load(std::memory_order_relaxed))
+                ++tracked_used;
+            tracked_index[i].store((chunk + 1) << SlotBits | slot, std::memory_order_release);
+        }
+        return true;
+    }
+
+    void Unindex(const char* begin, const size_t size, const size_t slot)
+    {
+        const auto [first, last] = Chunks(begin, size);
+        for (auto chunk = first; chunk <= last; ++chunk)
+        {
+            auto i = IndexOf(chunk);
+            while (tracked_index[i].load(std::memory_order_relaxed) != ((chunk + 1) << SlotBits | slot))
+                i = (i + 1) & (IndexSize - 1);
+            tracked_index[i].store(Tombstone, std::memory_order_release);
+
+            // tombstones that end a chain are no longer in anyone's way
+            while (tracked_index[i].load(std::memory_order_relaxed) == Tombstone && !tracked_index[(i + 1) & (IndexSize - 1)].load(std::memory_order_relaxed))
+            {
+                tracked_index[i].store(0, std::memory_order_release);
+                --tracked_used;
+                i = (i - 1) & (IndexSize - 1);
+            }
+        }
+    }
+
+    size_t HostPageSize()
+    {
+        static const auto size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    // a write to a write-protected page of tracked memory: log the page and let the write
+    // through, which retries it
+    bool OnTrackedWrite(const char* address)
+    {
+        const auto chunk = reinterpret_cast<uintptr_t>(address) >> ChunkBits;
+        for (auto i = IndexOf(chunk);; i = (i + 1) & (IndexSize - 1))
+        {
+            const auto entry = tracked_index[i].load(std::memory_order_acquire);
+            if (!entry)
+                return false;
+            if (entry == Tombstone || entry >> SlotBits != chunk + 1)
+                continue;
+
+            auto& memory = tracked[entry & ((uint64_t{1} << SlotBits) - 1)];
+            const auto begin = memory.Begin.load(std::memory_order_acquire);
+            if (!begin || address < begin || address >= begin + memory.Size)
+                continue;
+
+            const auto page = static_cast<size_t>(address - begin) / memory.PageSize;
+            if (!memory.Map[page])
+            {
+                memory.Map[page] = 1;
+                memory.Log[(*memory.Count)++] = static_cast<uint32_t>(page);
+            }
+            if (*memory.Watching && *memory.WatchCount < memory.Size / memory.PageSize)
+            {
+                // keep what the page held before the write that is let through
+                const auto n = (*memory.WatchCount)++;
+                memory.Watched[n] = static_cast<uint32_t>(page);
+                memcpy(memory.Before + n * memory.PageSize, begin + page * memory.PageSize, memory.PageSize);
+            }
+            return mprotect(begin + page * memory.PageSize, memory.PageSize, PROT_READ | PROT_WRITE) == 0;
+        }
+    }
+
+    // the handlers form guest addresses as a signed 32-bit sum and index guest memory with it, so
+    // every load and store lands in [memory - 2 GiB, memory + 2 GiB + 3). a guarded memory sits
+    // in an inaccessible window that covers all of it
+    constexpr size_t GuardBelow = size_t{1} << 31;
+    constexpr size_t GuardAbove = (size_t{1} << 31) + (size_t{1} << 16);
+    constexpr size_t GuardWindow = GuardBelow + GuardAbove;
+
+    struct GuardScope
+    {
+        const char* Begin;
+        const char* End;
+        sigjmp_buf Env;
+        GuardScope* Outer;
+    };
+
+    // the guarded runs active on this thread, innermost first. a guest can run another from an
+    // ecall handler
+    thread_local GuardScope* guard_scope = nullptr;
+    struct sigaction previous_action;
+
+    void OnSegv(const int sig, siginfo_t* info, void* context)
+    {
+        const auto address = static_cast<const char*>(info->si_addr);
+        if (OnTrackedWrite(address))
+            return;
+        for (auto scope = guard_scope; scope; scope = scope->Outer)
+            if (address >= scope->Begin && address < scope->End)
+                siglongjmp(scope->Env, 1);
+
+        // not a guest access, hand it to whoever had the signal before. returning with the
+        // default action back in place faults again and ends the process as usual
+        if (previous_action.sa_flags & SA_SIGINFO)
+            previous_action.sa_sigaction(sig, info, context);
+        else if (previous_action.sa_handler == SIG_DFL || previous_action.sa_handler == SIG_IGN)
+            sigaction(SIGSEGV, &previous_action, nullptr);
+        else
+            previous_action.sa_handler(sig);
+    }
+
+    void InstallGuardHandler()
+    {
+        static std::once_flag once;
+        std::call_once(once, []
+        {
+            // SA_NODEFER: the handler leaves through siglongjmp without restoring the signal mask,
+            // so SIGSEGV must not be blocked while it runs
+            struct sigaction action{};
+            action.sa_sigaction = OnSegv;
+            action.sa_flags = SA_SIGINFO | SA_NODEFER;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGSEGV, &action, &previous_action);
+        });
+    }
+
+    // size bytes of read-write memory, anonymous zero pages or a private mapping of fd, optionally
+    // inside a guard window
+    char* MapMemory(const size_t size, const bool guarded, const int fd = -1, const off_t offset = 0)
+    {
+        constexpr auto prot = PROT_READ | PROT_WRITE;
+        const auto flags = fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE : MAP_PRIVATE;
+        if (!guarded)
+        {
+            const auto memory = mmap(nullptr, size, prot, flags, fd, offset);
+            return memory == MAP_FAILED ? nullptr : static_cast<char*>(memory);
+        }
+
+        if (size > GuardAbove - (size_t{1} << 16))
+            return nullptr;
+        const auto window = mmap(nullptr, GuardWindow, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (window == MAP_FAILED)
+            return nullptr;
+        const auto memory = static_cast<char*>(window) + GuardBelow;
+        if (mmap(memory, size, prot, flags | MAP_FIXED, fd, offset) == MAP_FAILED)
+        {
+            munmap(window, GuardWindow);
+            return nullptr;
+        }
+        InstallGuardHandler();
+        return memory;
+    }
+
+    void UnmapMemory(char* memory, const size_t size, const bool guarded)
+    {
+        if (guarded)
+            munmap(memory - GuardBelow, GuardWindow);
+        else
+            munmap(memory, size);
+    }
+
+    // the snapshot holds guest memory followed by the decode cache, which starts on a host page
+    size_t OpsOffset(const size_t memory_size)
+    {
+        const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return (memory_size + page - 1) / page * page;
+    }
+}
+
+#endif
+
+void RiscVM::VM::AllocateOps()
+{
+    // calloc hands out fresh zero pages for big caches, so pages the guest never runs stay
+    // untouched
+    free(m_Ops);
+    m_OpCount = (m_MemorySize >> 2) + 1;
+    m_Ops = static_cast<Op*>(calloc(m_OpCount, sizeof(Op)));
+}
+
+void RiscVM::VM::Release()
+{
+    Untrack();
+    switch (m_Backing)
+    {
+    case Backing_Heap:
+        free(m_Memory);
+        free(m_Ops);
+        break;
+    case Backing_Reserved:
+    case Backing_Snapshot:
+    case Backing_File:
+#if defined(__linux__)
+        UnmapMemory(m_Memory, m_MemorySize, m_Guarded);
+        munmap(m_Ops, m_OpCount * sizeof(Op));
+#endif
+        break;
+    case Backing_Attached:
+        free(m_Ops);
+        break;
+    }
+    m_Ops = nullptr;
+    m_OpCount = 0;
+    m_Backing = Backing_Heap;
+    m_Guarded = false;
+}
+
+bool RiscVM::VM::IsZero(const char* data, const size_t size)
+{
+    return !size || (!data[0] && !memcmp(data, data + 1, size - 1));
+}
+
+bool RiscVM::VM::LoadFile(const std::string& path, const size_t memory_size)
+{
+    if (MapFile(path, memory_size))
+        return true;
+
+    // not a regular file, or no mmap: read it in one go and load the copy
+    std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
+    if (!stream.is_open())
+        return false;
+    std::vector<char> pgm;
+    constexpr size_t chunk = 1 << 20;
+    while (stream)
+    {
+        const auto at = pgm.size();
+        pgm.resize(at + chunk);
+        stream.read(pgm.data() + at, chunk);
+        pgm.resize(at + static_cast<size_t>(stream.gcount()));
+    }
+    Load(pgm.data(), pgm.size(), memory_size);
+    return true;
+}
+
+void RiscVM::VM::DropSnapshot()
+{
+#if defined(__linux__)
+    if (m_Snapshot >= 0)
+        close(m_Snapshot);
+#endif
+    m_Snapshot = -1;
+}
+
+bool RiscVM::VM::ResetToImage()
+{
+    if (!m_Image)
+        return false;
+
+    // restored memory is not what a snapshot taken at this instruction count holds
+    DropSnapshot();
+#if defined(__linux__)
+    if (m_TrackSlot >= 0)
+    {
+        const auto page = HostPageSize();
+        const auto log = m_DirtyLog.get();
+        std::sort(log, log + m_DirtyCount);
+        for (size_t i = 0; i < m_DirtyCount; ++i)
+        {
+            const auto begin = log[i] * page;
+            Restore(begin, std::min(begin + page, m_MemorySize));
+            m_DirtyMap[log[i]] = 0;
+        }
+        WriteProtect(log, m_DirtyCount);
+        m_DirtyCount = 0;
+    }
+    else
+#endif
+    {
+        for (size_t at = 0; at < m_MemorySize; at += PageSize)
+            Restore(at, std::min<size_t>(at + PageSize, m_MemorySize));
+    }
+
+    std::fill(std::begin(m_Registers), std::end(m_Registers), 0);
+    Reset();
+    m_Status = 0;
+    if (m_Console)
+        m_Console->Discard();
+    return true;
+}
+
+void RiscVM::VM::Restore(const size_t begin, const size_t end)
+{
+    // the image up to its end, zeros past it
+    const auto image_end = std::clamp(m_ImageSize, begin, end);
+    const auto image = m_Image.get();
+    const auto same = !memcmp(m_Memory + begin, image + begin, image_end - begin) && IsZero(m_Memory + image_end, end - image_end);
+    if (same)
+        return;
+    memcpy(m_Memory + begin, image + begin, image_end - begin);
+    memset(m_Memory + image_end, 0, end - image_end);
+
+    // code decoded from what the guest wrote; reading the slots of a page that never ran keeps
+    // them zero pages
+    for (auto page = begin >> PageBits; page << PageBits < end; ++page)
+    {
+        const auto ops = m_Ops + (page << (PageBits - 2));
+        const auto count = std::min<size_t>(PageSize >> 2, m_OpCount - (page << (PageBits - 2)));
+        if (std::any_of(ops, ops + count, [](const Op& op) { return op.Handler != Handler_Invalid; }))
+            std::fill(ops, ops + count, Op{});
+        InvalidateBlocks(static_cast<uint32_t>(page));
+    }
+}
+
+#if defined(__linux__)
+
+bool RiscVM::VM::Reserve(const size_t size)
+{
+    const auto op_count = (size >> 2) + 1;
+    if (m_Backing == Backing_Reserved && m_MemorySize == size && m_Guarded == m_GuardPages)
+    {
+        // dropping the pages turns both back into zero pages without a new mapping
+        madvise(m_Memory, m_MemorySize, MADV_DONTNEED);
+        madvise(m_Ops, m_OpCount * sizeof(Op), MADV_DONTNEED);
+        return true;
+    }
+    // small guests are cheaper on the heap, where reloading is a memcpy rather than a round of
+    // page faults, unless they asked for guard pages or write tracking, which need mappings
+    if (!size || (size < ReserveThreshold && !m_GuardPages && !m_DirtyTracking))
+        return false;
+
+    const auto memory = MapMemory(size, m_GuardPages);
+    if (!memory)
+        return false;
+    const auto ops = MapMemory(op_count * sizeof(Op), false);
+    if (!ops)
+    {
+        UnmapMemory(memory, size, m_GuardPages);
+        return false;
+    }
+
+    Release();
+    m_Memory = memory;
+    m_MemorySize = size;
+    m_Ops = reinterpret_cast<Op*>(ops);
+    m_OpCount = op_count;
+    m_Backing = Backing_Reserved;
+    m_Guarded = m_GuardPages;
+    return true;
+}
+
+bool RiscVM::VM::MapFile(const std::string& path, const size_t memory_size)
+{
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st{};
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // zero pages for the whole memory, then the file privately over its start. the file's last
+    // page reads as zero past the end of the file, and the guest's writes stay in its own copies
+    const auto len = static_cast<size_t>(st.st_size);
+    const auto size = std::max(len, memory_size);
+    const auto op_count = (size >> 2) + 1;
+    const auto memory = MapMemory(size, m_GuardPages);
+    if (!memory)
+    {
+        close(fd);
+        return false;
+    }
+    const auto image = mmap(memory, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    // a second, read-only view of the file is the image ResetToImage() restores from. it
+    // shares the page cache instead of copying the file
+    const auto pristine = m_DirtyTracking && image != MAP_FAILED ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    const auto ops = image == MAP_FAILED || pristine == MAP_FAILED ? nullptr : MapMemory(op_count * sizeof(Op), false);
+    if (!ops)
+    {
+        if (pristine && pristine != MAP_FAILED)
+            munmap(pristine, len);
+        UnmapMemory(memory, size, m_GuardPages);
+        return false;
+    }
+
+    DropSnapshot();
+    Release();
+    m_Image.reset();
+    m_ImageSize = 0;
+    if (pristine)
+    {
+        m_Image = std::shared_ptr<const char[]>(static_cast<const char*>(pristine), [len](const char* view)
+        {
+            munmap(const_cast<char*>(view), len);
+        });
+        m_ImageSize = len;
+    }
+    m_Memory = memory;
+    m_MemorySize = size;
+    m_Ops = reinterpret_cast<Op*>(ops);
+    m_OpCount = op_count;
+    m_Backing = Backing_File;
+    m_Guarded = m_GuardPages;
+    FlushBlocks();
+    Track();
+    return true;
+}
+
+bool RiscVM::VM::Snapshot()
+{
+    DropSnapshot();
+    m_Snapshot = memfd_create("riscvm", MFD_CLOEXEC);
+    if (m_Snapshot < 0)
+        return false;
+
+    const auto offset = OpsOffset(m_MemorySize);
+    // the file starts out as a hole, so zero pages are skipped and stay shared zero pages
+    const auto write = [this](const void* data, const size_t size, const size_t at)
+    {
+        const auto bytes = static_cast<const char*>(data);
+        for (size_t page = 0; page < size; page += PageSize)
+        {
+            const auto end = std::min<size_t>(page + PageSize, size);
+            if (IsZero(bytes + page, end - page))
+                continue;
+            for (auto done = page; done < end;)
+            {
+                const auto n = pwrite(m_Snapshot, bytes + done, end - done, static_cast<off_t>(at + done));
+                if (n <= 0)
+                    return false;
+                done += n;
+            }
+        }
+        return true;
+    };
+    if (ftruncate(m_Snapshot, static_cast<off_t>(offset + m_OpCount * sizeof(Op)))
+        || !write(m_Memory, m_MemorySize, 0)
+        || !write(m_Ops, m_OpCount * sizeof(Op), offset))
+    {
+        DropSnapshot();
+        return false;
+    }
+    m_SnapshotAt = m_Instructions;
+
+    // the parent moves onto the snapshot too, so it shares its pages with the children instead
+    // of keeping a copy of its own. memory someone else owns has to stay where it is
+    char* memory;
+    Op* ops;
+    if (m_Backing != Backing_Attached && Map(memory, ops))
+    {
+        const auto guarded = m_Guarded;
+        Release();
+        m_Memory = memory;
+        m_Ops = ops;
+        m_OpCount = (m_MemorySize >> 2) + 1;
+        m_Backing = Backing_Snapshot;
+        m_Guarded = guarded;
+        // the new mapping holds the pages the log already knows about
+        if (m_Image)
+            Track(m_DirtyLog.get(), m_DirtyCount);
+    }
+    return true;
+}
+
+bool RiscVM::VM::Map(char*& memory, Op*& ops) const
+{
+    const auto ops_size = m_OpCount * sizeof(Op);
+    const auto m = MapMemory(m_MemorySize, m_Guarded, m_Snapshot);
+    if (!m)
+        return false;
+    const auto o = MapMemory(ops_size, false, m_Snapshot, static_cast<off_t>(OpsOffset(m_MemorySize)));
+    if (!o)
+    {
+        UnmapMemory(m, m_MemorySize, m_Guarded);
+        return false;
+    }
+    memory = m;
+    ops = reinterpret_cast<Op*>(o);
+    return true;
+}
+
+bool RiscVM::VM::Track(const uint32_t* dirty, const size_t count)
+{
+    if (!m_Image || m_Backing == Backing_Heap || m_Backing == Backing_Attached)
+        return false;
+
+    const auto page = HostPageSize();
+    const auto pages = (m_MemorySize + page - 1) / page;
+    if (m_DirtyCapacity != pages)
+    {
+        m_DirtyMap = std::make_unique<uint8_t[]>(pages);
+        m_DirtyLog = std::make_unique_for_overwrite<uint32_t[]>(pages);
+        m_DirtyCapacity = pages;
+        m_DirtyCount = 0;
+    }
+    // the log starts out as the pages given: none after a load, the parent's in a fork, and
+    // itself when the memory moves onto a snapshot
+    if (dirty != m_DirtyLog.get())
+    {
+        for (size_t i = 0; i < m_DirtyCount; ++i)
+            m_DirtyMap[m_DirtyLog[i]] = 0;
+        std::copy_n(dirty, count, m_DirtyLog.get());
+        for (size_t i = 0; i < count; ++i)
+            m_DirtyMap[dirty[i]] = 1;
+        m_DirtyCount = count;
+    }
+
+    {
+        std::lock_guard lock(tracked_mutex);
+        size_t slot = 0;
+        while (slot < tracked_end && tracked[slot].Begin.load(std::memory_order_relaxed))
+            ++slot;
+        if (slot == MaxTracked)
+            return false;
+
+        auto& memory = tracked[slot];
+        memory.Size = pages * page;
+        memory.PageSize = page;
+        memory.Map = m_DirtyMap.get();
+        memory.Log = m_DirtyLog.get();
+        memory.Count = &m_DirtyCount;
+        memory.Watching = &m_Watching;
+        memory.Watched = m_Watched.get();
+        memory.Before = m_Before;
+        memory.WatchCount = &m_WatchCount;
+        memory.Begin.store(m_Memory, std::memory_order_release);
+        if (!Index(m_Memory, memory.Size, slot))
+        {
+            memory.Begin.store(nullptr, std::memory_order_relaxed);
+            return false;
+        }
+        tracked_end = std::max(tracked_end, slot + 1);
+        m_TrackSlot = static_cast<int>(slot);
+    }
+
+    // pages already in the log are protected too; their next write only lifts it again
+    InstallGuardHandler();
+    if (mprotect(m_Memory, pages * page, PROT_READ))
+    {
+        Untrack();
+        return false;
+    }
+    return true;
+}
+
+void RiscVM::VM::Untrack()
+{
+    if (m_TrackSlot < 0)
+        return;
+
+    const auto page = HostPageSize();
+    mprotect(m_Memory, (m_MemorySize + page - 1) / page * page, PROT_READ | PROT_WRITE);
+    {
+        std::lock_guard lock(tracked_mutex);
+        auto& memory = tracked[m_TrackSlot];
+        const auto begin = memory.Begin.load(std::memory_order_relaxed);
+        memory.Begin.store(nullptr, std::memory_order_release);
+        Unindex(begin, memory.Size, static_cast<size_t>(m_TrackSlot));
+        m_TrackSlot = -1;
+    }
+
+    m_Watching = false;
+    m_WatchCount = 0;
+    m_Watched.reset();
+    if (m_Before)
+        munmap(m_Before, m_DirtyCapacity * page);
+    m_Before = nullptr;
+}
+
+size_t RiscVM::VM::DirtyPageSize() const
+{
+    return m_TrackSlot >= 0 ? HostPageSize() : 0;
+}
+
+bool RiscVM::VM::Watch(const bool written)
+{
+    if (m_TrackSlot < 0)
+        return false;
+
+    const auto page = HostPageSize();
+    if (!m_Before)
+    {
+        // room for every page, but only the saved ones ever get backed
+        const auto before = mmap(nullptr, m_DirtyCapacity * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (before == MAP_FAILED)
+            return false;
+        m_Before = static_cast<char*>(before);
+        m_Watched = std::make_unique_for_overwrite<uint32_t[]>(m_DirtyCapacity);
+
+        std::lock_guard lock(tracked_mutex);
+        tracked[m_TrackSlot].Watched = m_Watched.get();
+        tracked[m_TrackSlot].Before = m_Before;
+    }
+
+    // pages written before are writable, and their next write would go unseen
+    if (written)
+    {
+        const auto log = m_DirtyLog.get();
+        std::sort(log, log + m_DirtyCount);
+        WriteProtect(log, m_DirtyCount);
+    }
+    m_WatchCount = 0;
+    m_Watching = true;
+    return true;
+}
+
+void RiscVM::VM::Unwatch(const std::function<void(uint32_t address, const char* before, size_t size)>& written)
+{
+    if (!m_Watching)
+        return;
+    m_Watching = false;
+
+    const auto page = HostPageSize();
+    std::vector<size_t> order(m_WatchCount);
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [this](const size_t a, const size_t b) { return m_Watched[a] < m_Watched[b]; });
+    for (const auto i : order)
+    {
+        const auto address = m_Watched[i] * page;
+        if (address < m_MemorySize)
+            written(static_cast<uint32_t>(address), m_Before + i * page, std::min(page, m_MemorySize - address));
+    }
+    m_WatchCount = 0;
+}
+
+void RiscVM::VM::WriteProtect(const uint32_t* pages, const size_t count) const
+{
+    // pages is sorted, so a run of neighbors goes in one call
+    const auto page = HostPageSize();
+    for (size_t i = 0; i < count;)
+    {
+        auto j = i + 1;
+        while (j < count && pages[j] == pages[j - 1] + 1)
+            ++j;
+        mprotect(m_Memory + pages[i] * page, (j - i) * page, PROT_READ);
+        i = j;
+    }
+}
+
+void RiscVM::VM::Protect(const std::function<void()>& body)
+{
+    if (!m_Guarded)
+    {
+        body();
+        return;
+    }
+
+    // an exception out of an ecall handler must not leave a dead scope behind
+    struct Enter
+    {
+        GuardScope Scope;
+
+        explicit Enter(const char* memory)
+            : Scope{memory - GuardBelow, memory + GuardAbove, {}, guard_scope}
+        {
+            guard_scope = &Scope;
+        }
+
+        ~Enter()
+        {
+            guard_scope = Scope.Outer;
+        }
+    } enter(m_Memory);
+
+    if (sigsetjmp(enter.Scope.Env, 0) == 0)
+        body();
+    else
+        Fault();
+}
+
+bool RiscVM::VM::CallHost(const int32_t number)
+{
+    // a fault is only recovered from in the engines' own loads and stores. one in a handler, or
+    // in libc under it, must not siglongjmp through their frames, which skips destructors and
+    // can leave locks held, so it ends the process like any host fault. guest runs the handler
+    // starts push scopes of their own
+    struct Leave
+    {
+        GuardScope* Saved = std::exchange(guard_scope, nullptr);
+
+        ~Leave()
+        {
+            guard_scope = Saved;
+        }
+    } leave;
+
+    return m_ECallMap.Call(*this, number);
+}
+
+#else
+
+bool RiscVM::VM::Reserve(size_t)
+{
+    return false;
+}
+
+bool RiscVM::VM::MapFile(const std::string&, size_t)
+{
+    return false;
+}
+
+bool RiscVM::VM::Snapshot()
+{
+    return false;
+}
+
+bool RiscVM::VM::Map(char*&, Op*&) const
+{
+    return false;
+}
+
+bool RiscVM::VM::Track(const uint32_t*, size_t)
+{
+    return false;
+}
+
+void RiscVM::VM::Untrack()
+{
+}
+
+size_t RiscVM::VM::DirtyPageSize() const
+{
+    return 0;
+}
+
+bool RiscVM::VM::Watch(bool)
+{
+    return false;
+}
+
+void RiscVM::VM::Unwatch(const std::function<void(uint32_t, const char*, size_t)>&)
+{
+}
+
+void RiscVM::VM::WriteProtect(const uint32_t*, size_t) const
+{
+}
+
+void RiscVM::VM::Protect(const std::function<void()>& body)
+{
+    body();
+}
+
+bool RiscVM::VM::CallHost(const int32_t number)
+{
+    return m_ECallMap.Call(*this, number);
+}
+
+#endif
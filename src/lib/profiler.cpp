@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <map>
+#include <numeric>
+#include <RiscVM/Profiler.hpp>
+
+namespace
+{
+    // ops after which the next retired instruction starts a block
+    constexpr auto Ends = []
+    {
+        std::array<bool, RiscVM::Handler_Count> ends{};
+        for (auto handler = RiscVM::Handler_JAL; handler <= RiscVM::Handler_BGEU; handler = static_cast<RiscVM::Handler>(handler + 1))
+            ends[handler] = true;
+        ends[RiscVM::Handler_ECALL] = true;
+        ends[RiscVM::Handler_EBREAK] = true;
+        return ends;
+    }();
+
+    struct Row
+    {
+        uint32_t Address;
+        uint64_t Count;
+    };
+
+    void PrintTable(std::ostream& stream, const char* title, std::vector<Row> rows, const uint64_t total, const RiscVM::SymbolMap& symbols, const size_t top)
+    {
+        const auto n = std::min(top, rows.size());
+        std::partial_sort(rows.begin(), rows.begin() + static_cast<ptrdiff_t>(n), rows.end(), [](const Row& a, const Row& b)
+        {
+            return a.Count != b.Count ? a.Count > b.Count : a.Address < b.Address;
+        });
+
+        stream << title << '\n';
+        for (size_t i = 0; i < n; ++i)
+        {
+            const auto& [address, count] = rows[i];
+            stream
+                << std::setw(14) << count << ' '
+                << std::setw(7) << std::fixed << std::setprecision(2) << (total ? 100.0 * static_cast<double>(count) / static_cast<double>(total) : 0.0) << "% "
+                << std::hex << std::setw(8) << std::setfill('0') << address << std::setfill(' ') << std::dec << ' '
+                << RiscVM::Symbolize(symbols, address) << '\n';
+        }
+    }
+}
+
+void RiscVM::Profiler::Retire(VM&, const uint32_t pc, const Op& op)
+{
+    const auto index = pc >> 2;
+    if (index >= m_Counts.size())
+        Grow(index);
+
+    ++m_Counts[index];
+    if (pc != m_Next)
+        ++m_Entries[index];
+    m_Next = Ends[op.Handler] ? ~0u : pc + 4;
+}
+
+void RiscVM::Profiler::Grow(const uint32_t index)
+{
+    const auto size = std::max<size_t>(index + 1, m_Counts.size() * 2);
+    m_Counts.resize(size);
+    m_Entries.resize(size);
+}
+
+void RiscVM::Profiler::Clear()
+{
+    m_Counts.clear();
+    m_Entries.clear();
+    m_Next = ~0u;
+}
+
+void RiscVM::Profiler::Report(std::ostream& stream, const SymbolMap& symbols, const size_t top) const
+{
+    const auto total = Instructions();
+    std::vector<Row> labels;
+    std::vector<Row> blocks;
+    std::vector<Row> pcs;
+    uint64_t entries = 0;
+
+    // every retirement is charged to the nearest label at or below its pc
+    std::map<uint32_t, uint64_t> per_label;
+    for (uint32_t i = 0; i < m_Counts.size(); ++i)
+    {
+        const auto address = i << 2;
+        if (m_Counts[i])
+        {
+            pcs.push_back({address, m_Counts[i]});
+            auto label = symbols.upper_bound(address);
+            per_label[label == symbols.begin() ? 0 : std::prev(label)->first] += m_Counts[i];
+        }
+        if (m_Entries[i])
+        {
+            blocks.push_back({address, m_Entries[i]});
+            entries += m_Entries[i];
+        }
+    }
+    for (const auto& [address, count] : per_label)
+        labels.push_back({address, count});
+
+    stream << "profile: " << total << " instructions in " << blocks.size() << " blocks\n";
+    PrintTable(stream, "hottest labels (instructions)", std::move(labels), total, symbols, top);
+    PrintTable(stream, "hottest blocks (entries)", std::move(blocks), entries, symbols, top);
+    PrintTable(stream, "hottest instructions", std::move(pcs), total, symbols, top);
+    stream.flush();
+}
+
+uint64_t RiscVM::Profiler::Count(const uint32_t pc) const
+{
+    return pc >> 2 < m_Counts.size() ? m_Counts[pc >> 2] : 0;
+}
+
+uint64_t RiscVM::Profiler::Entries(const uint32_t pc) const
+{
+    return pc >> 2 < m_Entries.size() ? m_Entries[pc >> 2] : 0;
+}
+
+uint64_t RiscVM::Profiler::Instructions() const
+{
+    return std::accumulate(m_Counts.begin(), m_Counts.end(), uint64_t{0});
+}
@@ -5,32 +5,32 @@
 
 void RiscVM::VM::LUI(const uint32_t rd, const int32_t imm)
 {
-    R(rd) = imm;
+    X(rd) = imm;
 }
 
 void RiscVM::VM::AUIPC(const uint32_t rd, const int32_t imm)
 {
-    R(rd) = imm + m_PC;
+    X(rd) = imm + m_PC;
 }
 
 void RiscVM::VM::JAL(const uint32_t rd, const int32_t imm)
 {
-    R(rd) = m_PC + 4;
+    X(rd) = m_PC + 4;
     m_PC += imm;
     m_DirtyPC = true;
 }
 
 void RiscVM::VM::JALR(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    const auto a = R(rs1) + imm;
-    R(rd) = m_PC + 4;
+    const auto a = X(rs1) + imm;
+    X(rd) = m_PC + 4;
     m_PC = a;
     m_DirtyPC = true;
 }
 
 void RiscVM::VM::BEQ(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    if (R(rs1) == R(rs2))
+    if (X(rs1) == X(rs2))
     {
         m_PC += imm;
         m_DirtyPC = true;
@@ -39,7 +39,7 @@ void RiscVM::VM::BEQ(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 
 void RiscVM::VM::BNE(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    if (R(rs1) != R(rs2))
+    if (X(rs1) != X(rs2))
     {
         m_PC += imm;
         m_DirtyPC = true;
@@ -48,7 +48,7 @@ void RiscVM::VM::BNE(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 
 void RiscVM::VM::BLT(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    if (R(rs1) < R(rs2))
+    if (X(rs1) < X(rs2))
     {
         m_PC += imm;
         m_DirtyPC = true;
@@ -57,7 +57,7 @@ void RiscVM::VM::BLT(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 
 void RiscVM::VM::BGE(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    if (R(rs1) >= R(rs2))
+    if (X(rs1) >= X(rs2))
     {
         m_PC += imm;
         m_DirtyPC = true;
@@ -66,7 +66,7 @@ void RiscVM::VM::BGE(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 
 void RiscVM::VM::BLTU(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    if (static_cast<uint32_t>(R(rs1)) < static_cast<uint32_t>(R(rs2)))
+    if (static_cast<uint32_t>(X(rs1)) < static_cast<uint32_t>(X(rs2)))
     {
         m_PC += imm;
         m_DirtyPC = true;
@@ -75,7 +75,7 @@ void RiscVM::VM::BLTU(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 
 void RiscVM::VM::BGEU(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    if (static_cast<uint32_t>(R(rs1)) >= static_cast<uint32_t>(R(rs2)))
+    if (static_cast<uint32_t>(X(rs1)) >= static_cast<uint32_t>(X(rs2)))
     {
         m_PC += imm;
         m_DirtyPC = true;
@@ -84,137 +84,145 @@ void RiscVM::VM::BGEU(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 
 void RiscVM::VM::LB(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = static_cast<uint8_t>(*reinterpret_cast<int8_t*>(&m_Memory[R(rs1) + imm]));
+    X(rd) = static_cast<uint8_t>(*reinterpret_cast<int8_t*>(&m_Memory[X(rs1) + imm]));
 }
 
 void RiscVM::VM::LH(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = *reinterpret_cast<int16_t*>(&m_Memory[R(rs1) + imm]);
+    X(rd) = *reinterpret_cast<int16_t*>(&m_Memory[X(rs1) + imm]);
 }
 
 void RiscVM::VM::LW(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = *reinterpret_cast<int32_t*>(&m_Memory[R(rs1) + imm]);
+    X(rd) = *reinterpret_cast<int32_t*>(&m_Memory[X(rs1) + imm]);
 }
 
 void RiscVM::VM::LBU(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = *reinterpret_cast<uint8_t*>(&m_Memory[R(rs1) + imm]);
+    X(rd) = *reinterpret_cast<uint8_t*>(&m_Memory[X(rs1) + imm]);
 }
 
 void RiscVM::VM::LHU(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = *reinterpret_cast<uint16_t*>(&m_Memory[R(rs1) + imm]);
+    X(rd) = *reinterpret_cast<uint16_t*>(&m_Memory[X(rs1) + imm]);
 }
 
 void RiscVM::VM::SB(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    *reinterpret_cast<int8_t*>(&m_Memory[R(rs2) + imm]) = static_cast<int8_t>(R(rs1));
+    const auto a = X(rs2) + imm;
+    *reinterpret_cast<int8_t*>(&m_Memory[a]) = static_cast<int8_t>(X(rs1));
+    Invalidate(a);
 }
 
 void RiscVM::VM::SH(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    *reinterpret_cast<int16_t*>(&m_Memory[R(rs2) + imm]) = static_cast<int16_t>(R(rs1));
+    const auto a = X(rs2) + imm;
+    *reinterpret_cast<int16_t*>(&m_Memory[a]) = static_cast<int16_t>(X(rs1));
+    Invalidate(a);
+    Invalidate(a + 1);
 }
 
 void RiscVM::VM::SW(const uint32_t rs1, const uint32_t rs2, const int32_t imm)
 {
-    *reinterpret_cast<int32_t*>(&m_Memory[R(rs2) + imm]) = R(rs1);
+    const auto a = X(rs2) + imm;
+    *reinterpret_cast<int32_t*>(&m_Memory[a]) = X(rs1);
+    Invalidate(a);
+    Invalidate(a + 3);
 }
 
 void RiscVM::VM::ADDI(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = R(rs1) + imm;
+    X(rd) = X(rs1) + imm;
 }
 
 void RiscVM::VM::SLTI(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = R(rs1) < imm;
+    X(rd) = X(rs1) < imm;
 }
 
 void RiscVM::VM::SLTIU(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = static_cast<uint32_t>(R(rs1)) < static_cast<uint32_t>(imm);
+    X(rd) = static_cast<uint32_t>(X(rs1)) < static_cast<uint32_t>(imm);
 }
 
 void RiscVM::VM::XORI(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = R(rs1) ^ imm;
+    X(rd) = X(rs1) ^ imm;
 }
 
 void RiscVM::VM::ORI(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = R(rs1) | imm;
+    X(rd) = X(rs1) | imm;
 }
 
 void RiscVM::VM::ANDI(const uint32_t rd, const uint32_t rs1, const int32_t imm)
 {
-    R(rd) = R(rs1) & imm;
+    X(rd) = X(rs1) & imm;
 }
 
 void RiscVM::VM::SLLI(const uint32_t rd, const uint32_t rs1, const uint32_t imm)
 {
-    R(rd) = R(rs1) << imm;
+    X(rd) = X(rs1) << imm;
 }
 
 void RiscVM::VM::SRLI(const uint32_t rd, const uint32_t rs1, const uint32_t imm)
 {
-    R(rd) = R(rs1) >> imm;
+    X(rd) = X(rs1) >> imm;
 }
 
 void RiscVM::VM::SRAI(const uint32_t rd, const uint32_t rs1, const uint32_t imm)
 {
-    R(rd) = R(rs1) >> imm;
+    X(rd) = X(rs1) >> imm;
 }
 
 void RiscVM::VM::ADD(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) + R(rs2);
+    X(rd) = X(rs1) + X(rs2);
 }
 
 void RiscVM::VM::SUB(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) - R(rs2);
+    X(rd) = X(rs1) - X(rs2);
 }
 
 void RiscVM::VM::SLL(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) << R(rs2);
+    X(rd) = X(rs1) << (X(rs2) & 31);
 }
 
 void RiscVM::VM::SLT(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) < R(rs2);
+    X(rd) = X(rs1) < X(rs2);
 }
 
 void RiscVM::VM::SLTU(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = static_cast<uint32_t>(R(rs1)) < static_cast<uint32_t>(R(rs2));
+    X(rd) = static_cast<uint32_t>(X(rs1)) < static_cast<uint32_t>(X(rs2));
 }
 
 void RiscVM::VM::XOR(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) ^ R(rs2);
+    X(rd) = X(rs1) ^ X(rs2);
 }
 
 void RiscVM::VM::SRL(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) >> R(rs2);
+    X(rd) = X(rs1) >> (X(rs2) & 31);
 }
 
 void RiscVM::VM::SRA(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) >> R(rs2);
+    X(rd) = X(rs1) >> (X(rs2) & 31);
 }
 
 void RiscVM::VM::OR(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) | R(rs2);
+    X(rd) = X(rs1) | X(rs2);
 }
 
 void RiscVM::VM::AND(const uint32_t rd, const uint32_t rs1, const uint32_t rs2)
 {
-    R(rd) = R(rs1) & R(rs2);
+    X(rd) = X(rs1) & X(rs2);
 }
 
 void RiscVM::VM::FENCE(const uint32_t rd, const uint32_t rs1, const uint32_t fm_pred_succ)
@@ -232,9 +240,12 @@ void RiscVM::VM::FENCE(const uint32_t rd, const uint32_t rs1, const uint32_t fm_
 
 void RiscVM::VM::ECALL()
 {
-    m_ECallMap[R(a7)](*this);
+    if (!CallHost(X(a7)))
+        Fault();
 }
 
 void RiscVM::VM::EBREAK()
 {
+    m_Stop = Stop_Breakpoint;
+    m_Pause = true;
 }
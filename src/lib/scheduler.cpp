@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <RiscVM/Bind.hpp>
+#include <RiscVM/Console.hpp>
+#include <RiscVM/ISA.hpp>
+#include <RiscVM/Scheduler.hpp>
+
+struct RiscVM::Scheduler::Guest
+{
+    Scheduler* Owner;
+    VM* Hart;
+    Pipe Input;
+
+    // guarded by the owner's mutex
+    bool Running = false;
+    std::coroutine_handle<> Resume;
+
+    // only touched by the worker running the guest: set while an ecall handler is suspended
+    bool Blocked = false;
+};
+
+static thread_local RiscVM::Scheduler::Guest* current_guest = nullptr;
+
+namespace
+{
+    RiscVM::ECallTask GetChar(RiscVM::VM& vm)
+    {
+        const auto pipe = RiscVM::Scheduler::Input();
+        if (!pipe)
+        {
+            vm.R<RiscVM::a0>() = vm.IO().Get();
+            co_return;
+        }
+
+        // the prompt the guest waits on must show before it parks
+        vm.IO().Flush();
+        int c;
+        while ((c = pipe->Get()) == RiscVM::Pipe::Empty)
+            co_await pipe->Readable();
+        vm.R<RiscVM::a0>() = c;
+    }
+
+    RiscVM::ECallTask GetLine(RiscVM::VM& vm)
+    {
+        std::span<char> buffer;
+        if (!RiscVM::Argument<std::span<char>>::Take(vm, vm.Registers() + RiscVM::a0, buffer))
+        {
+            vm.Fault();
+            co_return;
+        }
+
+        const auto pipe = RiscVM::Scheduler::Input();
+        if (!pipe)
+        {
+            vm.IO().GetLine(buffer.data(), buffer.size());
+            co_return;
+        }
+
+        vm.IO().Flush();
+        while (pipe->GetLine(buffer.data(), buffer.size()) == RiscVM::Pipe::Empty)
+            co_await pipe->Readable();
+    }
+}
+
+RiscVM::ECallTask::ECallTask(const std::coroutine_handle<promise_type> handle)
+    : m_Handle(handle)
+{
+}
+
+RiscVM::ECallTask::ECallTask(ECallTask&& other) noexcept
+    : m_Handle(std::exchange(other.m_Handle, {}))
+{
+}
+
+RiscVM::ECallTask::~ECallTask()
+{
+    // a task that was started destroys itself when it finishes
+    if (m_Handle)
+        m_Handle.destroy();
+}
+
+RiscVM::Scheduler::Scheduler(const uint32_t threads, const uint64_t quantum)
+    : m_Quantum(quantum ? quantum : 1)
+{
+    auto n = threads ? threads : std::thread::hardware_concurrency();
+    if (!n)
+        n = 1;
+    for (uint32_t i = 0; i < n; ++i)
+        m_Threads.emplace_back(&Scheduler::Loop, this);
+}
+
+RiscVM::Scheduler::~Scheduler()
+{
+    Wait();
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_Wake.notify_all();
+
+    for (auto& thread : m_Threads)
+        thread.join();
+}
+
+RiscVM::Pipe& RiscVM::Scheduler::Spawn(VM& vm)
+{
+    std::lock_guard lock(m_Mutex);
+    const auto guest = m_Guests.emplace_back(std::make_unique<Guest>()).get();
+    guest->Owner = this;
+    guest->Hart = &vm;
+    ++m_Live;
+    Enqueue(guest);
+    return guest->Input;
+}
+
+void RiscVM::Scheduler::Wait()
+{
+    std::unique_lock lock(m_Mutex);
+    m_Idle.wait(lock, [this] { return m_Live == 0; });
+}
+
+uint32_t RiscVM::Scheduler::Threads() const
+{
+    return static_cast<uint32_t>(m_Threads.size());
+}
+
+void RiscVM::Scheduler::Async(ECallTable& ecall_map, const int number, AsyncECall handler)
+{
+    ecall_map.Set(number, [handler = std::move(handler)](VM& vm)
+    {
+        Start(vm, handler(vm));
+    });
+}
+
+void RiscVM::Scheduler::Install(ECallTable& ecall_map)
+{
+    Async(ecall_map, 3, &GetChar);
+    Async(ecall_map, 4, &GetLine);
+}
+
+RiscVM::Pipe* RiscVM::Scheduler::Input()
+{
+    return current_guest ? &current_guest->Input : nullptr;
+}
+
+void RiscVM::Scheduler::Start(VM& vm, ECallTask task)
+{
+    const auto handle = std::exchange(task.m_Handle, {});
+    auto& promise = handle.promise();
+
+    const auto guest = current_guest;
+    if (guest && guest->Hart == &vm)
+    {
+        // a handler that finishes right away leaves the guest running; one that suspends
+        // parks it until a worker resumes the handler and it finishes there
+        guest->Blocked = true;
+        promise.OnDone = [guest](const std::exception_ptr& error)
+        {
+            guest->Blocked = false;
+            if (error)
+                guest->Hart->Fault();
+        };
+        handle.resume();
+        if (guest->Blocked)
+            vm.Yield();
+        return;
+    }
+
+    // not run by a Scheduler: whoever sets the event resumes the handler, this thread waits
+    const auto done = std::make_shared<std::atomic<bool>>(false);
+    std::exception_ptr failure;
+    promise.OnDone = [done, &failure](const std::exception_ptr& error)
+    {
+        failure = error;
+        done->store(true);
+        done->notify_all();
+    };
+    handle.resume();
+    done->wait(false);
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+void RiscVM::Scheduler::Ready(Guest* guest, const std::coroutine_handle<> handle)
+{
+    // a guest still on its way out of Run() is queued by its worker when it gets there
+    const auto owner = guest->Owner;
+    std::lock_guard lock(owner->m_Mutex);
+    guest->Resume = handle;
+    if (!guest->Running)
+        owner->Enqueue(guest);
+}
+
+void RiscVM::Scheduler::Loop()
+{
+    while (true)
+    {
+        Guest* guest;
+        std::coroutine_handle<> resume;
+        {
+            std::unique_lock lock(m_Mutex);
+            m_Wake.wait(lock, [this] { return m_Quit || !m_Queue.empty(); });
+            if (m_Queue.empty())
+                return;
+            guest = m_Queue.front();
+            m_Queue.pop_front();
+            guest->Running = true;
+            resume = std::exchange(guest->Resume, {});
+        }
+
+        current_guest = guest;
+        auto& vm = *guest->Hart;
+        auto reason = Stop_Yield;
+        try
+        {
+            if (resume)
+                resume.resume();
+            if (!guest->Blocked)
+                reason = vm.Run(m_Quantum);
+        }
+        catch (...)
+        {
+            vm.Fault();
+            reason = Stop_Fault;
+        }
+        current_guest = nullptr;
+
+        std::lock_guard lock(m_Mutex);
+        guest->Running = false;
+        if (guest->Blocked)
+        {
+            // parked until the event its handler waits on is set, unless that already happened
+            if (guest->Resume)
+                Enqueue(guest);
+        }
+        else if (reason == Stop_Exit || reason == Stop_Fault || reason == Stop_Fuel)
+        {
+            if (--m_Live == 0)
+                m_Idle.notify_all();
+        }
+        else
+            Enqueue(guest);
+    }
+}
+
+void RiscVM::Scheduler::Enqueue(Guest* guest)
+{
+    m_Queue.push_back(guest);
+    m_Wake.notify_one();
+}
+
+void RiscVM::Event::Set()
+{
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Set = true;
+        waiters.swap(m_Waiters);
+    }
+
+    for (const auto& [handle, guest] : waiters)
+    {
+        if (guest)
+            Scheduler::Ready(guest, handle);
+        else
+            handle.resume();
+    }
+}
+
+void RiscVM::Event::Reset()
+{
+    std::lock_guard lock(m_Mutex);
+    m_Set = false;
+}
+
+bool RiscVM::Event::IsSet() const
+{
+    std::lock_guard lock(m_Mutex);
+    return m_Set;
+}
+
+bool RiscVM::Event::Wait(const std::coroutine_handle<> handle)
+{
+    std::lock_guard lock(m_Mutex);
+    if (m_Set)
+        return false;
+    m_Waiters.push_back({handle, current_guest});
+    return true;
+}
+
+void RiscVM::Pipe::Write(const std::string_view data)
+{
+    if (data.empty())
+        return;
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Data.append(data);
+    }
+    // outside the lock, a waiter resumed right here reads the pipe again
+    m_Readable.Set();
+}
+
+void RiscVM::Pipe::Close()
+{
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Closed = true;
+    }
+    m_Readable.Set();
+}
+
+RiscVM::Event& RiscVM::Pipe::Readable()
+{
+    return m_Readable;
+}
+
+int RiscVM::Pipe::Get()
+{
+    std::lock_guard lock(m_Mutex);
+    if (m_Begin == m_Data.size())
+    {
+        if (m_Closed)
+            return -1;
+        // under the lock, so a write after this sets the event again
+        m_Readable.Reset();
+        return Empty;
+    }
+
+    const auto c = static_cast<unsigned char>(m_Data[m_Begin++]);
+    if (m_Begin == m_Data.size())
+    {
+        m_Data.clear();
+        m_Begin = 0;
+    }
+    return c;
+}
+
+int RiscVM::Pipe::GetLine(char* buffer, const size_t size)
+{
+    if (!size)
+        return -1;
+
+    std::lock_guard lock(m_Mutex);
+    const auto available = m_Data.size() - m_Begin;
+    const auto begin = m_Data.data() + m_Begin;
+    const auto newline = static_cast<const char*>(memchr(begin, '\n', std::min(available, size - 1)));
+    size_t n;
+    if (newline)
+        n = newline - begin + 1;
+    else if (available >= size - 1)
+        n = size - 1;
+    else if (m_Closed)
+    {
+        if (!available)
+            return -1;
+        n = available;
+    }
+    else
+    {
+        m_Readable.Reset();
+        return Empty;
+    }
+
+    memcpy(buffer, begin, n);
+    buffer[n] = 0;
+    m_Begin += n;
+    if (m_Begin == m_Data.size())
+    {
+        m_Data.clear();
+        m_Begin = 0;
+    }
+    return 1;
+}
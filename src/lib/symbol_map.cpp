@@ -0,0 +1,40 @@
+#include <iomanip>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <RiscVM/RiscVM.hpp>
+
+void RiscVM::WriteSymbols(std::ostream& stream, const SymbolMap& symbols)
+{
+    for (const auto& [address, name] : symbols)
+        stream << std::hex << std::setw(8) << std::setfill('0') << address << ' ' << name << '\n';
+    stream << std::dec;
+}
+
+RiscVM::SymbolMap RiscVM::ReadSymbols(std::istream& stream)
+{
+    SymbolMap symbols;
+    uint32_t address;
+    std::string name;
+    while (stream >> std::hex >> address >> name)
+        symbols.emplace(address, name);
+    return symbols;
+}
+
+std::string RiscVM::Symbolize(const SymbolMap& symbols, const uint32_t address)
+{
+    auto it = symbols.upper_bound(address);
+    if (it == symbols.begin())
+    {
+        std::ostringstream stream;
+        stream << "0x" << std::hex << address;
+        return stream.str();
+    }
+
+    --it;
+    if (it->first == address)
+        return it->second;
+    std::ostringstream stream;
+    stream << it->second << "+0x" << std::hex << address - it->first;
+    return stream.str();
+}
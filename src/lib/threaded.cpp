@@ -0,0 +1,243 @@
+#include <atomic>
+#include <iterator>
+#include <RiscVM/ISA.hpp>
+#include <RiscVM/TraceBuffer.hpp>
+#include <RiscVM/VM.hpp>
+
+#if defined(__GNUC__)
+
+void RiscVM::VM::RunThreaded()
+{
+    RunThreaded(false, 0);
+}
+
+void RiscVM::VM::RunThreaded(const bool step, const uint32_t until)
+{
+    // one instance per combination of policies, and of running free or stepping to a pc, picked
+    // once per Run()
+    typedef void (VM::*Instance)(uint32_t);
+#define HOOKS(c, s, u) {&VM::RunThreaded<c, s, Hook_None, u>, &VM::RunThreaded<c, s, Hook_Tracer, u>, &VM::RunThreaded<c, s, Hook_TraceBuffer, u>}
+#define INSTANCES(c, s) {HOOKS(c, s, false), HOOKS(c, s, true)}
+    static constexpr Instance instances[][2][2][3]
+    {
+        {INSTANCES(Check_None, Subset_RV32I), INSTANCES(Check_None, Subset_RV32IM)},
+        {INSTANCES(Check_Bounds, Subset_RV32I), INSTANCES(Check_Bounds, Subset_RV32IM)},
+        {INSTANCES(Check_Alignment, Subset_RV32I), INSTANCES(Check_Alignment, Subset_RV32IM)},
+    };
+#undef INSTANCES
+#undef HOOKS
+
+    const auto hook = !m_Tracer ? Hook_None : dynamic_cast<TraceBuffer*>(m_Tracer) ? Hook_TraceBuffer : Hook_Tracer;
+    (this->*instances[m_Check][m_Subset][step][hook])(until);
+}
+
+template <RiscVM::Check C, RiscVM::Subset S, RiscVM::VM::Hook H, bool U>
+void RiscVM::VM::RunThreaded(const uint32_t until)
+{
+    static const void* const labels[]
+    {
+#include "labels.inl"
+    };
+    static_assert(std::size(labels) == Handler_Count);
+
+    if (!m_Ok)
+        return;
+
+    int32_t* const x = m_Registers;
+    char* mem = m_Memory;
+    Op* ops = m_Ops;
+    size_t size = m_MemorySize;
+
+    auto pc = static_cast<uint32_t>(m_PC);
+    uint64_t n = 0;
+    uint64_t left = m_Deadline - m_Instructions;
+    const Op* op;
+    const auto trace = static_cast<TraceBuffer*>(m_Tracer);
+    uint32_t address = 0;
+    if constexpr (H == Hook_TraceBuffer)
+        trace->m_VM = this;
+
+    // every handler finishes by dispatching the next op itself. sequential flow runs into the
+    // zeroed slot past the end of memory, so only jumps need to check their target and the
+    // budget. a store that hit code dispatches right away, since the rest of a superinstruction
+    // may have been wiped. the policies compile to nothing when off: CHECK() guards loads and
+    // stores, EXTENSION_M() the RV32M ops and RETIRE() calls the tracer. stepping to a pc (U)
+    // checks it and the budget after every instruction and runs superinstructions unfused. a
+    // TraceBuffer gets the effective address of loads and stores, and the old words of code
+    // about to be stored into. a guarded store out of range only faults once it runs, so ops is
+    // read before it only after a range check, and the fence keeps the compiler from moving the
+    // read after it up past the store.
+#define PC() pc
+#define RETIRE() \
+    do \
+    { \
+        if constexpr (H == Hook_Tracer) \
+            m_Tracer->Retire(*this, pc, *op); \
+        else if constexpr (H == Hook_TraceBuffer) \
+            trace->Append(x, pc, *op, address); \
+    } \
+    while (false)
+#define HANDLER() (U ? static_cast<uint8_t>(Unfuse(static_cast<Handler>(op->Handler))) : op->Handler)
+#define DISPATCH() do { op = &ops[pc >> 2]; goto *labels[HANDLER()]; } while (false)
+#define UNTIL() do { if constexpr (U) { if (pc == until) { m_Stop = Stop_Breakpoint; goto stop; } if (n >= left) goto stop; } } while (false)
+#define NEXT() do { RETIRE(); ++n; pc += 4; UNTIL(); DISPATCH(); } while (false)
+#define STEP() do { RETIRE(); ++n; pc += 4; op = &ops[pc >> 2]; } while (false)
+#define JUMP(target) do { RETIRE(); ++n; pc = (target); if (pc >= size || pc & 0b11 || (!U && n >= left)) goto stop; UNTIL(); DISPATCH(); } while (false)
+#define WRITE(rd, value) do { x[rd] = (value); } while (false)
+#define CHECK(type, a) \
+    do \
+    { \
+        if constexpr (C != Check_None) \
+        { \
+            const auto c_ = static_cast<uint32_t>(a); \
+            if (static_cast<uint64_t>(c_) + sizeof(type) > size || (C == Check_Alignment && (c_ & (sizeof(type) - 1)))) \
+                goto fault; \
+        } \
+    } \
+    while (false)
+#define LOAD(type, a) \
+    do \
+    { \
+        const auto l_ = static_cast<uint32_t>(a); \
+        if constexpr (H == Hook_TraceBuffer) \
+            address = l_; \
+        CHECK(type, l_); \
+    } \
+    while (false)
+#define EXTENSION_M() do { if constexpr (S == Subset_RV32I) goto fault; } while (false)
+#define STORE(type, a, value) \
+    do \
+    { \
+        const int32_t a_ = (a); \
+        CHECK(type, a_); \
+        if constexpr (H == Hook_TraceBuffer) \
+        { \
+            address = static_cast<uint32_t>(a_); \
+            if (uint64_t{address} + sizeof(type) <= size && (ops[address >> 2].Handler || ops[(address + sizeof(type) - 1) >> 2].Handler)) \
+                trace->Overwrite(mem, ops, m_OpCount, address, sizeof(type)); \
+        } \
+        *reinterpret_cast<type*>(&mem[a_]) = static_cast<type>(value); \
+        std::atomic_signal_fence(std::memory_order_seq_cst); \
+        if (ops[static_cast<uint32_t>(a_) >> 2].Handler || ops[static_cast<uint32_t>(a_ + sizeof(type) - 1) >> 2].Handler) \
+        { \
+            Invalidate(a_); \
+            Invalidate(a_ + sizeof(type) - 1); \
+            NEXT(); \
+        } \
+    } \
+    while (false)
+
+    DISPATCH();
+
+op_Invalid:
+    if (pc >= size)
+        goto stop;
+    m_PC = static_cast<int32_t>(pc);
+    DecodePage(pc >> PageBits);
+    if (op->Handler == Handler_Invalid)
+        goto fault;
+    goto *labels[HANDLER()];
+
+op_JAL:
+    WRITE(op->Rd, pc + 4);
+    JUMP(pc + op->Imm);
+op_JALR:
+    {
+        const auto target = x[op->Rs1] + op->Imm;
+        WRITE(op->Rd, pc + 4);
+        JUMP(target);
+    }
+
+op_BEQ:
+    if (x[op->Rs1] == x[op->Rs2]) JUMP(pc + op->Imm);
+    NEXT();
+op_BNE:
+    if (x[op->Rs1] != x[op->Rs2]) JUMP(pc + op->Imm);
+    NEXT();
+op_BLT:
+    if (x[op->Rs1] < x[op->Rs2]) JUMP(pc + op->Imm);
+    NEXT();
+op_BGE:
+    if (x[op->Rs1] >= x[op->Rs2]) JUMP(pc + op->Imm);
+    NEXT();
+op_BLTU:
+    if (static_cast<uint32_t>(x[op->Rs1]) < static_cast<uint32_t>(x[op->Rs2])) JUMP(pc + op->Imm);
+    NEXT();
+op_BGEU:
+    if (static_cast<uint32_t>(x[op->Rs1]) >= static_cast<uint32_t>(x[op->Rs2])) JUMP(pc + op->Imm);
+    NEXT();
+
+#include "handlers.inl"
+
+op_EBREAK:
+    EBREAK();
+    RETIRE();
+    ++n;
+    pc += 4;
+    goto stop;
+
+op_ECALL:
+    m_PC = static_cast<int32_t>(pc);
+    m_Instructions += n;
+    left -= n;
+    n = 0;
+    ECALL();
+    mem = m_Memory;
+    ops = m_Ops;
+    size = m_MemorySize;
+    if (!m_Ok || m_Pause)
+    {
+        RETIRE();
+        ++n;
+        pc += 4;
+        goto stop;
+    }
+    NEXT();
+
+#undef RETIRE
+#undef HANDLER
+#undef DISPATCH
+#undef UNTIL
+#undef NEXT
+#undef STEP
+#undef JUMP
+#undef WRITE
+#undef CHECK
+#undef LOAD
+#undef EXTENSION_M
+#undef STORE
+#undef PC
+
+fault:
+    Fault();
+
+stop:
+    m_PC = static_cast<int32_t>(pc);
+    m_Instructions += n;
+    if (m_Ok && (pc >= size || pc & 0b11))
+        Fault();
+}
+
+#else
+
+void RiscVM::VM::RunThreaded()
+{
+    // computed goto is a GNU extension, other compilers keep the switch loop
+    while (Cycle() && !m_Pause && m_Instructions < m_Deadline)
+    {
+    }
+}
+
+void RiscVM::VM::RunThreaded(bool, const uint32_t until)
+{
+    while (Cycle() && !m_Pause && m_Instructions < m_Deadline)
+    {
+        if (static_cast<uint32_t>(m_PC) == until)
+        {
+            m_Stop = Stop_Breakpoint;
+            break;
+        }
+    }
+}
+
+#endif
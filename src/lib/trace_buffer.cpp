@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+#include <unordered_map>
+#include <RiscVM/ISA.hpp>
+#include <RiscVM/RiscVM.hpp>
+#include <RiscVM/TraceBuffer.hpp>
+
+namespace
+{
+    constexpr char Magic[4] = {'R', 'V', 'T', 'R'};
+    constexpr uint8_t Version = 1;
+
+    bool WritesRd(const RiscVM::Format form)
+    {
+        switch (form)
+        {
+        case RiscVM::Format_R:
+        case RiscVM::Format_I:
+        case RiscVM::Format_Shift:
+        case RiscVM::Format_Load:
+        case RiscVM::Format_U:
+        case RiscVM::Format_J:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // jalr shares the load layout, but only real loads touch memory
+    bool Accesses(const uint32_t word)
+    {
+        const auto form = RiscVM::Instructions[RiscVM::Identify(word)].Form;
+        return form == RiscVM::Format_S || (form == RiscVM::Format_Load && (word & 0x7f) == RiscVM::RV32_64G_LOAD);
+    }
+
+    bool Writes(const uint32_t word)
+    {
+        return RiscVM::Rd(word) && WritesRd(RiscVM::Instructions[RiscVM::Identify(word)].Form);
+    }
+
+    // values the word and pc already determine are not stored: lui, auipc and the link of jal
+    // and jalr. the recorder also sees fused lui/auipc heads only after their addi ran
+    bool Derive(const uint32_t word, const uint32_t pc, uint32_t& value)
+    {
+        switch (word & 0x7f)
+        {
+        case RiscVM::RV32_64G_LUI:
+            value = static_cast<uint32_t>(RiscVM::ImmediateU(word));
+            return true;
+        case RiscVM::RV32_64G_AUIPC:
+            value = pc + static_cast<uint32_t>(RiscVM::ImmediateU(word));
+            return true;
+        case RiscVM::RV32_64G_JAL:
+        case RiscVM::RV32_64G_JALR:
+            value = pc + 4;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void PutVarint(std::ostream& stream, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            stream.put(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        stream.put(static_cast<char>(value));
+    }
+
+    uint64_t GetVarint(std::istream& stream)
+    {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            const auto c = stream.get();
+            if (c < 0)
+                throw std::runtime_error("truncated trace");
+            value |= static_cast<uint64_t>(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return value;
+        }
+        throw std::runtime_error("malformed trace");
+    }
+
+    // signed deltas of 32-bit values, small magnitudes first
+    uint32_t ZigZag(const uint32_t delta)
+    {
+        const auto d = static_cast<int32_t>(delta);
+        return static_cast<uint32_t>(d << 1) ^ static_cast<uint32_t>(d >> 31);
+    }
+
+    uint32_t UnZigZag(const uint32_t z)
+    {
+        return z >> 1 ^ (0u - (z & 1));
+    }
+
+    // the state both sides of the delta encoding keep in step
+    struct Context
+    {
+        uint32_t PC = 0;
+        uint32_t Address = 0;
+        uint32_t Registers[32]{};
+        std::unordered_map<uint32_t, uint32_t> Words;
+    };
+}
+
+RiscVM::TraceBuffer::TraceBuffer(const size_t capacity)
+    : m_Ring(std::make_unique_for_overwrite<Slot[]>(std::bit_ceil(std::max<size_t>(capacity, 1)))),
+      m_Mask(std::bit_ceil(std::max<size_t>(capacity, 1)) - 1)
+{
+}
+
+void RiscVM::TraceBuffer::Retire(VM& vm, const uint32_t pc, const Op& op)
+{
+    m_VM = &vm;
+    const auto x = vm.Registers();
+    if (!m_Synced)
+    {
+        std::copy_n(x, RegisterSink + 1, m_Shadow);
+        m_Synced = true;
+    }
+
+    // stores name their base in rs2, everything else in rs1, and a load that overwrites its base
+    // finds the old one in the shadow
+    const auto handler = op.Handler;
+    const auto base = static_cast<uint8_t>(handler - Handler_SB) <= Handler_SW - Handler_SB ? op.Rs2 : op.Rs1;
+    const auto address = (base == op.Rd ? m_Shadow[base] : x[base]) + op.Imm;
+    m_Shadow[op.Rd] = x[op.Rd];
+
+    // the host may have written any register
+    if (handler == Handler_ECALL)
+        std::copy_n(x, RegisterSink + 1, m_Shadow);
+
+    Append(x, pc, op, static_cast<uint32_t>(address));
+}
+
+void RiscVM::TraceBuffer::Overwrite(const char* memory, const Op* ops, const size_t op_count, const uint32_t address, const uint32_t size)
+{
+    const auto head = m_Head.load(std::memory_order_relaxed);
+    const std::lock_guard lock(m_Mutex);
+
+    // changes older than the ring no longer name any record's word
+    if (m_Changes.size() >= m_Prune)
+    {
+        std::erase_if(m_Changes, [&](const Change& change) { return change.Head + Capacity() <= head; });
+        m_Prune = std::max<size_t>(m_Prune, m_Changes.size() * 2);
+    }
+
+    for (auto page = address >> VM::PageBits; page <= (address + size - 1) >> VM::PageBits; ++page)
+    {
+        const auto beg = size_t{page} << (VM::PageBits - 2);
+        const auto end = std::min<size_t>(beg + (VM::PageSize >> 2), op_count);
+        for (auto i = beg; i < end; ++i)
+        {
+            if (ops[i].Handler == Handler_Invalid)
+                continue;
+            uint32_t word;
+            memcpy(&word, memory + (i << 2), sizeof(word));
+            m_Changes.push_back({head, static_cast<uint32_t>(i << 2), word});
+        }
+    }
+}
+
+void RiscVM::TraceBuffer::Clear()
+{
+    m_Head.store(0, std::memory_order_release);
+    const std::lock_guard lock(m_Mutex);
+    m_Changes.clear();
+    m_Synced = false;
+}
+
+size_t RiscVM::TraceBuffer::Capacity() const
+{
+    return m_Mask + 1;
+}
+
+uint64_t RiscVM::TraceBuffer::Retired() const
+{
+    return m_Head.load(std::memory_order_acquire);
+}
+
+void RiscVM::TraceBuffer::Write(std::ostream& stream) const
+{
+    const auto head = m_Head.load(std::memory_order_acquire);
+    const auto count = std::min<uint64_t>(head, Capacity());
+
+    // each record's word is the one memory holds now, unless the guest overwrote it later: then
+    // it is the old word of the first change at or after the record. walking back from the
+    // newest record undoes the changes in reverse until exactly those remain undone
+    std::vector<uint32_t> words(static_cast<size_t>(count));
+    {
+        const std::lock_guard lock(m_Mutex);
+        const auto memory = m_VM ? m_VM->Memory() : nullptr;
+        const auto size = m_VM ? m_VM->MemorySize() : 0;
+        std::unordered_map<uint32_t, uint32_t> undone;
+        auto change = m_Changes.size();
+        for (auto i = count; i--;)
+        {
+            const auto index = head - count + i;
+            for (; change && m_Changes[change - 1].Head >= index; --change)
+                undone[m_Changes[change - 1].Address] = m_Changes[change - 1].Word;
+
+            const auto pc = m_Ring[index & m_Mask].PC;
+            if (const auto it = undone.find(pc); it != undone.end())
+                words[i] = it->second;
+            else if (uint64_t{pc} + sizeof(uint32_t) <= size)
+                memcpy(&words[i], memory + pc, sizeof(uint32_t));
+            else
+                words[i] = 0;
+        }
+    }
+
+    stream.write(Magic, sizeof(Magic));
+    stream.put(static_cast<char>(Version));
+    PutVarint(stream, count);
+
+    // per record: the pc as a delta from the fall-through pc, shifted left by one with the low
+    // bit set when the word differs from the last one seen at that pc, then the word itself, the
+    // written value as a delta from that register's last value unless the word determines it,
+    // and the address of a load or store as a delta from the last address
+    Context context;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        const auto& slot = m_Ring[(head - count + i) & m_Mask];
+        const Record record{slot.PC, words[i], slot.Value, slot.Address};
+        const auto [word, inserted] = context.Words.try_emplace(record.PC, record.Word);
+        const auto changed = inserted || word->second != record.Word;
+        word->second = record.Word;
+
+        PutVarint(stream, static_cast<uint64_t>(ZigZag(record.PC - (context.PC + 4))) << 1 | changed);
+        context.PC = record.PC;
+        if (changed)
+            PutVarint(stream, record.Word);
+        if (Writes(record.Word))
+        {
+            auto& value = context.Registers[Rd(record.Word)];
+            if (!Derive(record.Word, record.PC, value))
+            {
+                PutVarint(stream, ZigZag(record.Value - value));
+                value = record.Value;
+            }
+        }
+        if (Accesses(record.Word))
+        {
+            PutVarint(stream, ZigZag(record.Address - context.Address));
+            context.Address = record.Address;
+        }
+    }
+    stream.flush();
+}
+
+std::vector<RiscVM::TraceBuffer::Record> RiscVM::TraceBuffer::Read(std::istream& stream)
+{
+    char magic[sizeof(Magic)];
+    if (!stream.read(magic, sizeof(magic)) || memcmp(magic, Magic, sizeof(Magic)) || stream.get() != Version)
+        throw std::runtime_error("not a trace");
+
+    const auto count = GetVarint(stream);
+    std::vector<Record> records;
+    records.reserve(static_cast<size_t>(std::min<uint64_t>(count, size_t{1} << 24)));
+
+    Context context;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        Record record{};
+        const auto head = GetVarint(stream);
+        record.PC = context.PC + 4 + UnZigZag(static_cast<uint32_t>(head >> 1));
+        context.PC = record.PC;
+        if (head & 1)
+            context.Words[record.PC] = static_cast<uint32_t>(GetVarint(stream));
+        record.Word = context.Words[record.PC];
+        if (Writes(record.Word))
+        {
+            auto& value = context.Registers[Rd(record.Word)];
+            if (!Derive(record.Word, record.PC, value))
+                value += UnZigZag(static_cast<uint32_t>(GetVarint(stream)));
+            record.Value = value;
+        }
+        if (Accesses(record.Word))
+        {
+            context.Address += UnZigZag(static_cast<uint32_t>(GetVarint(stream)));
+            record.Address = context.Address;
+        }
+        records.push_back(record);
+    }
+    return records;
+}
+
+void RiscVM::TraceBuffer::Print(std::ostream& stream, const std::vector<Record>& records)
+{
+    const auto flags = stream.flags();
+    const auto fill = stream.fill();
+    stream << std::hex << std::uppercase << std::setfill('0');
+    for (const auto& [pc, word, value, address] : records)
+    {
+        stream << std::setw(8) << pc << "  " << std::setw(8) << word << ": " << std::left << std::setfill(' ') << std::setw(24) << Disassemble(word) << std::right << std::setfill('0');
+        if (Writes(word))
+            stream << ' ' << RegisterName(Rd(word)) << '=' << std::setw(8) << value;
+        if (Accesses(word))
+            stream << " [" << std::setw(8) << address << ']';
+        stream << '\n';
+    }
+    stream.flags(flags);
+    stream.fill(fill);
+}
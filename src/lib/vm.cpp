@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <random>
@@ -5,40 +6,245 @@
 #include <RiscVM/RiscVM.hpp>
 #include <RiscVM/VM.hpp>
 
+RiscVM::VM::~VM()
+{
+    Release();
+    DropSnapshot();
+}
+
 void RiscVM::VM::Reset()
 {
     m_PC = 0;
     m_DirtyPC = false;
     m_Ok = true;
+    m_Pause = false;
+    m_Stop = Stop_Exit;
 }
 
-void RiscVM::VM::Load(const char* pgm, const size_t len)
+void RiscVM::VM::Load(const char* pgm, const size_t len, const size_t memory_size)
 {
-    if (m_MemorySize < len)
+    const auto size = std::max(len, memory_size);
+    DropSnapshot();
+    Untrack();
+    m_Image.reset();
+    m_ImageSize = 0;
+    if (m_DirtyTracking)
     {
-        m_MemorySize = len;
-        m_Memory = static_cast<char*>(realloc(m_Memory, m_MemorySize));
+        const auto image = std::make_shared_for_overwrite<char[]>(len);
+        memcpy(image.get(), pgm, len);
+        m_Image = image;
+        m_ImageSize = len;
     }
+
+    if (Reserve(size))
+    {
+        // the pages start out as zero pages, so only the parts of the image that are not zero get
+        // written. a .bss or a stack costs nothing until the guest touches it
+        for (size_t at = 0; at < len; at += PageSize)
+        {
+            const auto n = std::min<size_t>(PageSize, len - at);
+            if (!IsZero(pgm + at, n))
+                memcpy(m_Memory + at, pgm + at, n);
+        }
+        FlushBlocks();
+        Track();
+        return;
+    }
+
+    if (m_Backing != Backing_Heap)
+    {
+        Release();
+        m_Memory = nullptr;
+    }
+    m_MemorySize = size;
+    m_Memory = static_cast<char*>(realloc(m_Memory, m_MemorySize));
     memcpy(m_Memory, pgm, len);
+    memset(m_Memory + len, 0, m_MemorySize - len);
+    AllocateOps();
+    FlushBlocks();
+}
+
+void RiscVM::VM::Attach(char* memory, const size_t size)
+{
+    Release();
+    DropSnapshot();
+    m_Image.reset();
+    m_ImageSize = 0;
+    m_Memory = memory;
+    m_MemorySize = size;
+    m_Backing = Backing_Attached;
+    AllocateOps();
+    FlushBlocks();
+}
+
+std::unique_ptr<RiscVM::VM> RiscVM::VM::Fork()
+{
+    auto child = std::make_unique<VM>();
+    std::copy(std::begin(m_Registers), std::end(m_Registers), child->m_Registers);
+    child->m_PC = m_PC;
+    child->m_Status = m_Status;
+    child->m_Ok = m_Ok;
+    child->m_Stop = m_Stop;
+    child->m_Instructions = m_Instructions;
+    child->m_Fuel = m_Fuel;
+    child->m_HartId = m_HartId;
+    child->m_Engine = m_Engine;
+    child->m_Check = m_Check;
+    child->m_Subset = m_Subset;
+    child->m_ECallMap = m_ECallMap;
+    if (m_Console)
+    {
+        // the child writes after everything the parent wrote so far, and reads on from where the
+        // source is, past what the parent has buffered
+        m_Console->Flush();
+        child->IO().Output() = m_Console->Output();
+        child->IO().Input() = m_Console->Input();
+        child->IO().FlushPolicy() = m_Console->FlushPolicy();
+    }
+    child->m_GuardPages = m_GuardPages;
+    child->m_DirtyTracking = m_DirtyTracking;
+    child->m_Image = m_Image;
+    child->m_ImageSize = m_ImageSize;
+
+    if (!m_Ops)
+        return child;
+    child->m_MemorySize = m_MemorySize;
+    child->m_OpCount = m_OpCount;
+
+    // attached memory may change under us at any time, so its snapshot is never reused
+    const auto current = m_Snapshot >= 0 && m_Backing != Backing_Attached && m_SnapshotAt == m_Instructions;
+    if ((current || Snapshot()) && Map(child->m_Memory, child->m_Ops))
+    {
+        child->m_Backing = Backing_Snapshot;
+        child->m_Guarded = m_Guarded;
+        // the child starts out with the parent's written pages, which the log knows if it is
+        // complete
+        if (m_TrackSlot >= 0)
+            child->Track(m_DirtyLog.get(), m_DirtyCount);
+        return child;
+    }
+
+    child->m_Memory = static_cast<char*>(malloc(m_MemorySize));
+    memcpy(child->m_Memory, m_Memory, m_MemorySize);
+    child->m_Ops = static_cast<Op*>(malloc(m_OpCount * sizeof(Op)));
+    std::copy_n(m_Ops, m_OpCount, child->m_Ops);
+    return child;
 }
 
 bool RiscVM::VM::Cycle()
 {
-    if (m_Ok && m_PC >= 0 && m_PC < m_MemorySize)
+    if (m_Ok && m_PC >= 0 && static_cast<size_t>(m_PC) < m_MemorySize && !(m_PC & 0b11))
     {
-        const auto inst = *reinterpret_cast<uint32_t*>(&m_Memory[m_PC]);
-        Exec(inst);
+        const auto& op = m_Ops[m_PC >> 2];
+        if (op.Handler == Handler_Invalid)
+        {
+            DecodePage(m_PC >> PageBits);
+            if (op.Handler == Handler_Invalid)
+                return Fault();
+        }
+
+        Exec(op);
+        ++m_Instructions;
         if (!m_DirtyPC)
             m_PC += 4;
         else m_DirtyPC = false;
         return true;
     }
 
-    return m_Ok = false;
+    return m_Ok && Fault();
+}
+
+RiscVM::StopReason RiscVM::VM::Run(const uint64_t max_instructions)
+{
+    if (!Begin(max_instructions))
+        return Finish();
+
+    Protect([this]
+    {
+        if (m_Check != Check_None || m_Subset != Subset_RV32IM || m_Tracer)
+        {
+            RunThreaded();
+            return;
+        }
+
+        switch (m_Engine)
+        {
+        case Engine_Switch:
+            while (Cycle() && !m_Pause && m_Instructions < m_Deadline)
+            {
+            }
+            break;
+        case Engine_Threaded:
+            RunThreaded();
+            break;
+        case Engine_Block:
+            RunBlocks();
+            break;
+        case Engine_JIT:
+            RunJIT();
+            break;
+        }
+    });
+
+    return Finish();
+}
+
+RiscVM::StopReason RiscVM::VM::RunUntil(const uint32_t pc, const uint64_t max_instructions)
+{
+    if (!Begin(max_instructions))
+        return Finish();
+
+    Protect([this, pc]
+    {
+        RunThreaded(true, pc);
+    });
+
+    return Finish();
+}
+
+void RiscVM::VM::Yield()
+{
+    m_Stop = Stop_Yield;
+    m_Pause = true;
+}
+
+bool RiscVM::VM::Begin(const uint64_t max_instructions)
+{
+    // a stopped guest keeps reporting the reason it stopped for
+    m_Pause = false;
+    m_Started = m_Instructions;
+    if (!m_Ok)
+        return false;
+
+    m_Stop = Stop_Budget;
+    const auto budget = std::min(max_instructions, m_Fuel);
+    m_Deadline = budget > ~m_Instructions ? ~0ull : m_Instructions + budget;
+    return m_Instructions < m_Deadline;
+}
+
+RiscVM::StopReason RiscVM::VM::Finish()
+{
+    m_Fuel -= std::min(m_Instructions - m_Started, m_Fuel);
+    if (m_Ok && m_Stop == Stop_Budget && !m_Fuel)
+        m_Stop = Stop_Fuel;
+    if (!m_Ok && m_Stop != Stop_Fault)
+        m_Stop = Stop_Exit;
+    if (!m_Ok && m_Console)
+        m_Console->Flush();
+    return m_Stop;
+}
+
+bool RiscVM::VM::Fault()
+{
+    m_Ok = false;
+    m_Stop = Stop_Fault;
+    return false;
 }
 
 char* RiscVM::VM::Memory() const
 {
+    // the host may write through it, into private pages the snapshot does not see
+    m_SnapshotAt = ~0ull;
     return m_Memory;
 }
 
@@ -47,6 +253,41 @@ size_t RiscVM::VM::MemorySize() const
     return m_MemorySize;
 }
 
+bool& RiscVM::VM::GuardPages()
+{
+    return m_GuardPages;
+}
+
+bool RiscVM::VM::Guarded() const
+{
+    return m_Guarded;
+}
+
+bool& RiscVM::VM::DirtyTracking()
+{
+    return m_DirtyTracking;
+}
+
+size_t RiscVM::VM::DirtyPages() const
+{
+    return m_TrackSlot >= 0 ? m_DirtyCount : 0;
+}
+
+std::span<const uint32_t> RiscVM::VM::DirtyLog() const
+{
+    return {m_DirtyLog.get(), DirtyPages()};
+}
+
+uint64_t RiscVM::VM::Instructions() const
+{
+    return m_Instructions;
+}
+
+uint64_t& RiscVM::VM::Fuel()
+{
+    return m_Fuel;
+}
+
 bool& RiscVM::VM::Ok()
 {
     return m_Ok;
@@ -57,72 +298,140 @@ int32_t& RiscVM::VM::Status()
     return m_Status;
 }
 
+int32_t& RiscVM::VM::PC()
+{
+    return m_PC;
+}
+
+uint32_t& RiscVM::VM::HartId()
+{
+    return m_HartId;
+}
+
+RiscVM::Engine& RiscVM::VM::ActiveEngine()
+{
+    return m_Engine;
+}
+
+RiscVM::Check& RiscVM::VM::Checking()
+{
+    return m_Check;
+}
+
+RiscVM::Subset& RiscVM::VM::ISASubset()
+{
+    return m_Subset;
+}
+
+RiscVM::Tracer*& RiscVM::VM::ActiveTracer()
+{
+    return m_Tracer;
+}
+
 int32_t& RiscVM::VM::R(const uint32_t r)
 {
     if (r == 0)
-        return m_Registers[0] = 0;
+        return m_Registers[RegisterSink] = 0;
     return m_Registers[r];
 }
 
-std::map<int, RiscVM::ECall>& RiscVM::VM::ECallMap()
+RiscVM::ECallTable& RiscVM::VM::ECallMap()
 {
     return m_ECallMap;
 }
 
-void RiscVM::VM::Exec(const uint32_t data)
+RiscVM::Console& RiscVM::VM::IO()
 {
-    switch (ISA(data))
+    if (!m_Console)
+        m_Console = std::make_unique<Console>();
+    return *m_Console;
+}
+
+void RiscVM::VM::Exec(const Op& op)
+{
+    switch (op.Handler)
     {
-    case RV32I_LUI: return LUI(Rd(data), ImmediateU(data));
-    case RV32I_AUIPC: return AUIPC(Rd(data), ImmediateU(data));
-    case RV32I_JAL: return JAL(Rd(data), ImmediateJ(data));
-    case RV32I_JALR: return JALR(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_BEQ: return BEQ(Rs1(data), Rs2(data), ImmediateB(data));
-    case RV32I_BNE: return BNE(Rs1(data), Rs2(data), ImmediateB(data));
-    case RV32I_BLT: return BLT(Rs1(data), Rs2(data), ImmediateB(data));
-    case RV32I_BGE: return BGE(Rs1(data), Rs2(data), ImmediateB(data));
-    case RV32I_BLTU: return BLTU(Rs1(data), Rs2(data), ImmediateB(data));
-    case RV32I_BGEU: return BGEU(Rs1(data), Rs2(data), ImmediateB(data));
-    case RV32I_LB: return LB(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_LH: return LH(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_LW: return LW(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_LBU: return LBU(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_LHU: return LHU(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_SB: return SB(Rs1(data), Rs2(data), ImmediateS(data));
-    case RV32I_SH: return SH(Rs1(data), Rs2(data), ImmediateS(data));
-    case RV32I_SW: return SW(Rs1(data), Rs2(data), ImmediateS(data));
-    case RV32I_ADDI: return ADDI(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_SLTI: return SLTI(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_SLTIU: return SLTIU(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_XORI: return XORI(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_ORI: return ORI(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_ANDI: return ANDI(Rd(data), Rs1(data), ImmediateI(data));
-    case RV32I_SLLI: return SLLI(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_SRLI: return SRLI(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_SRAI: return SRAI(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_ADD: return ADD(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_SUB: return SUB(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_SLL: return SLL(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_SLT: return SLT(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_SLTU: return SLTU(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_XOR: return XOR(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_SRL: return SRL(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_SRA: return SRA(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_OR: return OR(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_AND: return AND(Rd(data), Rs1(data), Rs2(data));
-    case RV32I_ECALL: return ECALL();
-    case RV32I_EBREAK: return EBREAK();
-    case RV32I_FENCE: return FENCE(Rd(data), Rs1(data), ImmediateI(data));
-
-    case RV32M_MUL: return MUL(Rd(data), Rs1(data), Rs2(data));
-    case RV32M_MULH: return MULH(Rd(data), Rs1(data), Rs2(data));
-    case RV32M_MULHSU: return MULHSU(Rd(data), Rs1(data), Rs2(data));
-    case RV32M_MULHU: return MULHU(Rd(data), Rs1(data), Rs2(data));
-    case RV32M_DIV: return DIV(Rd(data), Rs1(data), Rs2(data));
-    case RV32M_DIVU: return DIVU(Rd(data), Rs1(data), Rs2(data));
-    case RV32M_REM: return REM(Rd(data), Rs1(data), Rs2(data));
-    case RV32M_REMU: return REMU(Rd(data), Rs1(data), Rs2(data));
+    case Handler_LUI: return LUI(op.Rd, op.Imm);
+    case Handler_AUIPC: return AUIPC(op.Rd, op.Imm);
+    case Handler_JAL: return JAL(op.Rd, op.Imm);
+    case Handler_JALR: return JALR(op.Rd, op.Rs1, op.Imm);
+    case Handler_BEQ: return BEQ(op.Rs1, op.Rs2, op.Imm);
+    case Handler_BNE: return BNE(op.Rs1, op.Rs2, op.Imm);
+    case Handler_BLT: return BLT(op.Rs1, op.Rs2, op.Imm);
+    case Handler_BGE: return BGE(op.Rs1, op.Rs2, op.Imm);
+    case Handler_BLTU: return BLTU(op.Rs1, op.Rs2, op.Imm);
+    case Handler_BGEU: return BGEU(op.Rs1, op.Rs2, op.Imm);
+    case Handler_LB: return LB(op.Rd, op.Rs1, op.Imm);
+    case Handler_LH: return LH(op.Rd, op.Rs1, op.Imm);
+    case Handler_LW: return LW(op.Rd, op.Rs1, op.Imm);
+    case Handler_LBU: return LBU(op.Rd, op.Rs1, op.Imm);
+    case Handler_LHU: return LHU(op.Rd, op.Rs1, op.Imm);
+    case Handler_SB: return SB(op.Rs1, op.Rs2, op.Imm);
+    case Handler_SH: return SH(op.Rs1, op.Rs2, op.Imm);
+    case Handler_SW: return SW(op.Rs1, op.Rs2, op.Imm);
+    case Handler_ADDI: return ADDI(op.Rd, op.Rs1, op.Imm);
+    case Handler_SLTI: return SLTI(op.Rd, op.Rs1, op.Imm);
+    case Handler_SLTIU: return SLTIU(op.Rd, op.Rs1, op.Imm);
+    case Handler_XORI: return XORI(op.Rd, op.Rs1, op.Imm);
+    case Handler_ORI: return ORI(op.Rd, op.Rs1, op.Imm);
+    case Handler_ANDI: return ANDI(op.Rd, op.Rs1, op.Imm);
+    case Handler_SLLI: return SLLI(op.Rd, op.Rs1, op.Imm);
+    case Handler_SRLI: return SRLI(op.Rd, op.Rs1, op.Imm);
+    case Handler_SRAI: return SRAI(op.Rd, op.Rs1, op.Imm);
+    case Handler_ADD: return ADD(op.Rd, op.Rs1, op.Rs2);
+    case Handler_SUB: return SUB(op.Rd, op.Rs1, op.Rs2);
+    case Handler_SLL: return SLL(op.Rd, op.Rs1, op.Rs2);
+    case Handler_SLT: return SLT(op.Rd, op.Rs1, op.Rs2);
+    case Handler_SLTU: return SLTU(op.Rd, op.Rs1, op.Rs2);
+    case Handler_XOR: return XOR(op.Rd, op.Rs1, op.Rs2);
+    case Handler_SRL: return SRL(op.Rd, op.Rs1, op.Rs2);
+    case Handler_SRA: return SRA(op.Rd, op.Rs1, op.Rs2);
+    case Handler_OR: return OR(op.Rd, op.Rs1, op.Rs2);
+    case Handler_AND: return AND(op.Rd, op.Rs1, op.Rs2);
+    case Handler_ECALL: return ECALL();
+    case Handler_EBREAK: return EBREAK();
+    case Handler_FENCE: return FENCE(op.Rd, op.Rs1, op.Imm);
+
+    case Handler_MUL: return MUL(op.Rd, op.Rs1, op.Rs2);
+    case Handler_MULH: return MULH(op.Rd, op.Rs1, op.Rs2);
+    case Handler_MULHSU: return MULHSU(op.Rd, op.Rs1, op.Rs2);
+    case Handler_MULHU: return MULHU(op.Rd, op.Rs1, op.Rs2);
+    case Handler_DIV: return DIV(op.Rd, op.Rs1, op.Rs2);
+    case Handler_DIVU: return DIVU(op.Rd, op.Rs1, op.Rs2);
+    case Handler_REM: return REM(op.Rd, op.Rs1, op.Rs2);
+    case Handler_REMU: return REMU(op.Rd, op.Rs1, op.Rs2);
+
+    // one instruction per cycle here: a superinstruction runs as its first instruction, and the
+    // rest of the run follows from the untouched slots behind it
+    case Handler_LA:
+    case Handler_CALL: return AUIPC(op.Rd, op.Imm);
+    case Handler_LI: return LUI(op.Rd, op.Imm);
+    case Handler_PUSH:
+    case Handler_POP: return ADDI(op.Rd, op.Rs1, op.Imm);
 
     default: throw std::runtime_error("no such opcode");
     }
 }
+
+void RiscVM::VM::DecodePage(const uint32_t page)
+{
+    const size_t beg = page << PageBits;
+    const size_t end = std::min<size_t>(beg + PageSize, m_MemorySize & ~static_cast<size_t>(0b11));
+    for (auto pc = beg; pc < end; pc += 4)
+        m_Ops[pc >> 2] = Decode(*reinterpret_cast<uint32_t*>(&m_Memory[pc]));
+    if (beg < end)
+        Fuse(&m_Ops[beg >> 2], (end - beg) >> 2);
+}
+
+void RiscVM::VM::Invalidate(const uint32_t addr)
+{
+    // words that never decoded to an instruction are re-decoded by the miss path anyway
+    if (m_Ops[addr >> 2].Handler == Handler_Invalid)
+        return;
+
+    const auto beg = (addr >> PageBits) << (PageBits - 2);
+    const auto end = std::min<size_t>(beg + (PageSize >> 2), m_OpCount);
+    std::fill(m_Ops + beg, m_Ops + end, Op{});
+
+    InvalidateBlocks(addr >> PageBits);
+}
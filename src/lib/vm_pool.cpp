@@ -0,0 +1,196 @@
+#include <RiscVM/ISA.hpp>
+#include <RiscVM/VMPool.hpp>
+
+static thread_local RiscVM::JobResult* current_result = nullptr;
+
+RiscVM::VMPool::VMPool(const uint32_t workers, const ECallTable& ecall_map, const Engine engine)
+    : m_Engine(engine)
+{
+    const auto n = workers ? workers : 1;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        auto& worker = m_Workers.emplace_back(std::make_unique<Worker>());
+        worker->Hart.ECallMap() = ecall_map;
+    }
+
+    // the workers only start once m_Workers is complete, Take() walks all of it
+    for (uint32_t i = 0; i < n; ++i)
+        m_Workers[i]->Thread = std::thread(&VMPool::Loop, this, i);
+}
+
+RiscVM::VMPool::~VMPool()
+{
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_Wake.notify_all();
+
+    for (const auto& worker : m_Workers)
+        worker->Thread.join();
+}
+
+RiscVM::Image RiscVM::VMPool::Share(const char* pgm, const size_t len)
+{
+    return std::make_shared<const std::vector<char>>(pgm, pgm + len);
+}
+
+std::future<RiscVM::JobResult> RiscVM::VMPool::Submit(Job job)
+{
+    Task task{std::move(job), {}};
+    auto future = task.Promise.get_future();
+
+    ++m_Unfinished;
+    auto& worker = *m_Workers[m_Next++ % m_Workers.size()];
+    {
+        std::lock_guard lock(worker.Mutex);
+        worker.Queue.push_back(std::move(task));
+    }
+
+    // a worker that reserves this job is guaranteed to find it in some queue
+    {
+        std::lock_guard lock(m_Mutex);
+        ++m_Pending;
+    }
+    m_Wake.notify_one();
+    return future;
+}
+
+void RiscVM::VMPool::Wait()
+{
+    std::unique_lock lock(m_Mutex);
+    m_Idle.wait(lock, [this] { return m_Unfinished == 0; });
+}
+
+uint32_t RiscVM::VMPool::Workers() const
+{
+    return static_cast<uint32_t>(m_Workers.size());
+}
+
+std::string& RiscVM::VMPool::Output()
+{
+    return current_result->Output;
+}
+
+void RiscVM::VMPool::Loop(const uint32_t index)
+{
+    auto& vm = m_Workers[index]->Hart;
+    vm.ActiveEngine() = m_Engine;
+    vm.IO().FlushPolicy() = Console::Flush_Exit;
+    vm.IO().Output() = [](const char* data, const size_t size)
+    {
+        current_result->Output.append(data, size);
+    };
+
+    while (true)
+    {
+        if (!Reserve())
+        {
+            std::unique_lock lock(m_Mutex);
+            m_Wake.wait(lock, [this] { return m_Quit || m_Pending > 0; });
+            if (m_Quit && m_Pending == 0)
+                return;
+            continue;
+        }
+
+        auto task = Take(index);
+        try
+        {
+            task.Promise.set_value(Exec(*m_Workers[index], task.Work));
+        }
+        catch (...)
+        {
+            task.Promise.set_exception(std::current_exception());
+        }
+
+        if (--m_Unfinished == 0)
+        {
+            std::lock_guard lock(m_Mutex);
+            m_Idle.notify_all();
+        }
+    }
+}
+
+bool RiscVM::VMPool::Reserve()
+{
+    auto pending = m_Pending.load();
+    while (pending > 0)
+        if (m_Pending.compare_exchange_weak(pending, pending - 1))
+            return true;
+    return false;
+}
+
+RiscVM::VMPool::Task RiscVM::VMPool::Take(const uint32_t index)
+{
+    const auto n = m_Workers.size();
+    while (true)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto& worker = *m_Workers[(index + i) % n];
+            std::lock_guard lock(worker.Mutex);
+            if (worker.Queue.empty())
+                continue;
+
+            Task task;
+            if (i == 0)
+            {
+                task = std::move(worker.Queue.front());
+                worker.Queue.pop_front();
+            }
+            else
+            {
+                task = std::move(worker.Queue.back());
+                worker.Queue.pop_back();
+            }
+            return task;
+        }
+    }
+}
+
+RiscVM::JobResult RiscVM::VMPool::Exec(Worker& worker, const Job& job)
+{
+    JobResult result;
+    current_result = &result;
+
+    // restoring what the last job wrote beats copying a large image, but costs a fault per
+    // written page, which a small image copies faster
+    auto& vm = worker.Hart;
+    const auto& image = *job.Program;
+    if (job.Program != worker.Loaded || !vm.ResetToImage())
+    {
+        vm.DirtyTracking() = image.size() >= VM::ReserveThreshold;
+        vm.Load(image.data(), image.size());
+        worker.Loaded = job.Program;
+    }
+    vm.IO().Input() = Console::StringSource(job.Input);
+    vm.IO().Discard();
+    vm.Reset();
+    vm.Status() = 0;
+    for (uint32_t r = 1; r < 32; ++r)
+        vm.R(r) = 0;
+    for (uint32_t i = 0; i < job.Args.size() && a0 + i <= a7; ++i)
+        vm.R(a0 + i) = job.Args[i];
+
+    const auto start = vm.Instructions();
+    auto left = job.MaxInstructions;
+    auto reason = vm.Run(left);
+    while (reason == Stop_Yield || reason == Stop_Breakpoint)
+    {
+        const auto retired = vm.Instructions() - start;
+        if (retired >= job.MaxInstructions)
+        {
+            reason = Stop_Budget;
+            break;
+        }
+        left = job.MaxInstructions - retired;
+        reason = vm.Run(left);
+    }
+
+    vm.IO().Flush();
+    current_result = nullptr;
+    result.Reason = reason;
+    result.Status = vm.Status();
+    result.Instructions = vm.Instructions() - start;
+    return result;
+}
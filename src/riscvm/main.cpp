@@ -1,103 +1,176 @@
-#include <cstdarg>
-#include <cstring>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <random>
 #include <vector>
 #include <RiscVM/ArgParser.hpp>
 #include <RiscVM/Assembler.hpp>
+#include <RiscVM/Bind.hpp>
+#include <RiscVM/CallProfiler.hpp>
+#include <RiscVM/ECallLog.hpp>
+#include <RiscVM/Machine.hpp>
+#include <RiscVM/Profiler.hpp>
+#include <RiscVM/TraceBuffer.hpp>
 #include <RiscVM/VM.hpp>
 
-static void va_init(va_list& ap, char* ptr)
+static int32_t random_between(const int32_t min, const int32_t max)
 {
-#ifdef _WIN32
-    ap = ptr;
-#else
-    typedef struct
-    {
-        unsigned int gp_offset;
-        unsigned int fp_offset;
-        void* overflow_arg_area;
-        void* reg_save_area;
-    } va_list_t[1];
-
-    va_list_t list;
-    list->gp_offset = 6 * 8; // 6 registers * 8 bytes
-    list->fp_offset = 6 * 8 + 8 * 16; // gp_offset + 8 registers * 16 bytes
-    list->overflow_arg_area = ptr;
-    list->reg_save_area = nullptr;
-
-    memcpy(&ap, &list, sizeof(va_list_t));
-#endif
+    thread_local std::random_device dev;
+    thread_local std::mt19937 rng(dev());
+    std::uniform_int_distribution<std::mt19937::result_type> dist(min, max);
+    return static_cast<int32_t>(dist(rng));
 }
 
-static int exec(const char* pgm, const size_t size)
+static void stop(RiscVM::VM& vm, const int32_t status)
 {
-    RiscVM::DumpRaw(pgm, size);
-    RiscVM::Dump(pgm, size);
+    vm.Ok() = false;
+    vm.Status() = status;
+}
 
-    RiscVM::VM vm;
-    vm.Load(pgm, size);
+static void install_ecalls(RiscVM::ECallTable& ecall_map)
+{
+    RiscVM::Console::Install(ecall_map);
+    ecall_map.Set(120, RiscVM::Bind<&random_between>);
+    ecall_map.Set(127, RiscVM::Bind<&stop>);
+}
+
+static void print_bench(const std::chrono::duration<double> seconds, const uint64_t instructions)
+{
+    std::cout
+        << "Executed " << instructions << " instructions in " << seconds.count() << "s ("
+        << static_cast<double>(instructions) / seconds.count() / 1e6 << " MIPS)" << std::endl;
+}
+
+// what a run carries besides the guest: at most one tracer, and an ecall log to record into or
+// to replay
+struct instrumentation
+{
+    bool profile = false;
+    std::string flame;
+    std::string trace;
+    size_t trace_size = 0;
+    std::string record;
+    std::optional<RiscVM::ECallLog> replay;
+};
+
+static int exec(RiscVM::VM& vm, const size_t size, const RiscVM::Engine engine, const bool bench, instrumentation& tools, const RiscVM::SymbolMap& symbols)
+{
+    RiscVM::DumpRaw(vm.Memory(), size);
+    RiscVM::Dump(vm.Memory(), size);
+
+    if (vm.GuardPages() && !vm.Guarded())
+        std::cerr << "guard pages are not available, running unguarded" << std::endl;
     vm.Reset();
+    vm.ActiveEngine() = engine;
+    install_ecalls(vm.ECallMap());
+
+    RiscVM::ECallLog record;
+    if (tools.replay)
+        tools.replay->Replay(vm);
+    else if (!tools.record.empty())
+        record.Record(vm);
+
+    RiscVM::Profiler profiler;
+    RiscVM::CallProfiler call_profiler;
+    std::unique_ptr<RiscVM::TraceBuffer> trace;
+    if (tools.profile)
+        vm.ActiveTracer() = &profiler;
+    else if (!tools.flame.empty())
+        vm.ActiveTracer() = &call_profiler;
+    else if (!tools.trace.empty())
+        vm.ActiveTracer() = (trace = std::make_unique<RiscVM::TraceBuffer>(tools.trace_size)).get();
+
+    const auto beg = std::chrono::steady_clock::now();
+    auto reason = RiscVM::Stop_Exit;
+    try
+    {
+        reason = vm.Run();
+        while (reason == RiscVM::Stop_Yield || reason == RiscVM::Stop_Breakpoint)
+            reason = vm.Run();
+    }
+    catch (const std::runtime_error& error)
+    {
+        // a replay that left the recorded path. the guest stays where it was
+        std::cerr << error.what() << std::endl;
+        reason = RiscVM::Stop_Fault;
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    if (reason == RiscVM::Stop_Fault)
+        std::cerr << "guest fault at pc " << std::hex << vm.PC() << std::dec << std::endl;
+    else if (reason == RiscVM::Stop_Fuel)
+        std::cerr << "guest ran out of fuel at pc " << std::hex << vm.PC() << std::dec << std::endl;
+
+    if (bench)
+        print_bench(end - beg, vm.Instructions());
+
+    if (tools.profile)
+        profiler.Report(std::cout, symbols);
+    else if (!tools.flame.empty())
+    {
+        call_profiler.Report(std::cout, symbols);
+        std::ofstream stream(tools.flame);
+        call_profiler.WriteFolded(stream, symbols);
+    }
+    else if (trace)
+    {
+        // whether the guest exited or faulted, the last instructions are what a post-mortem needs
+        std::ofstream stream(tools.trace, std::ios_base::out | std::ios_base::binary);
+        trace->Write(stream);
+    }
 
-    auto& ecall_map = vm.ECallMap();
-    ecall_map[0] = [](RiscVM::VM& vm_)
-    {
-        fputc(vm_.R(RiscVM::a0), stdout);
-        fflush(stdout);
-    };
-    ecall_map[1] = [](RiscVM::VM& vm_)
-    {
-        fputs(vm_.Memory() + vm_.R(RiscVM::a0), stdout);
-        fflush(stdout);
-    };
-    ecall_map[2] = [](RiscVM::VM& vm_)
-    {
-        va_list ap;
-        va_init(ap, vm_.Memory() + vm_.R(RiscVM::a1));
-        vfprintf(stdout, vm_.Memory() + vm_.R(RiscVM::a0), ap);
-        fflush(stdout);
-    };
-    ecall_map[3] = [](RiscVM::VM& vm_)
-    {
-        vm_.R(RiscVM::a0) = fgetc(stdin);
-    };
-    ecall_map[4] = [](RiscVM::VM& vm_)
-    {
-        fgets(vm_.Memory() + vm_.R(RiscVM::a0), vm_.R(RiscVM::a1), stdin);
-    };
-    ecall_map[5] = [](RiscVM::VM& vm_)
-    {
-        va_list ap;
-        va_init(ap, vm_.Memory() + vm_.R(RiscVM::a1));
-        vfscanf(stdin, vm_.Memory() + vm_.R(RiscVM::a0), ap);
-    };
-    ecall_map[120] = [](RiscVM::VM& vm_)
-    {
-        static std::random_device dev;
-        static std::mt19937 rng(dev());
-        std::uniform_int_distribution<std::mt19937::result_type> dist(vm_.R(RiscVM::a0), vm_.R(RiscVM::a1));
-        vm_.R(RiscVM::a0) = static_cast<int32_t>(dist(rng));
-    };
-    ecall_map[127] = [](RiscVM::VM& vm_)
-    {
-        vm_.Ok() = false;
-        vm_.Status() = vm_.R(RiscVM::a0);
-    };
-
-    do vm.Cycle();
-    while (vm.Ok());
+    if (!tools.record.empty())
+    {
+        std::ofstream stream(tools.record, std::ios_base::out | std::ios_base::binary);
+        record.Write(stream);
+    }
 
     return vm.Status();
 }
 
+static int exec_harts(const char* pgm, const size_t size, const size_t memory_size, const RiscVM::Engine engine, const bool bench, const uint32_t harts, const RiscVM::Check check, const RiscVM::Subset subset, const RiscVM::Console::Flushing flush, const uint64_t fuel)
+{
+    RiscVM::DumpRaw(pgm, size);
+    RiscVM::Dump(pgm, size);
+
+    RiscVM::Machine machine(harts);
+    machine.Load(pgm, size, memory_size);
+    machine.ActiveEngine() = engine;
+    for (uint32_t hart = 0; hart < harts; ++hart)
+    {
+        machine.Hart(hart).Checking() = check;
+        machine.Hart(hart).ISASubset() = subset;
+        machine.Hart(hart).IO().FlushPolicy() = flush;
+        machine.Hart(hart).Fuel() = fuel;
+    }
+    install_ecalls(machine.ECallMap());
+
+    const auto beg = std::chrono::steady_clock::now();
+    const auto status = machine.Run();
+    const auto end = std::chrono::steady_clock::now();
+
+    if (bench)
+        print_bench(end - beg, machine.Instructions());
+
+    return status;
+}
+
 static std::vector<char> read_bin(const std::string& filename)
 {
     if (filename.empty())
     {
+        // a pipe has no size to ask for, so read it in large blocks straight into the vector
+        constexpr size_t chunk = 1 << 20;
         std::vector<char> pgm;
-        for (int c; (c = std::cin.get()) >= 0;)
-            pgm.push_back(static_cast<char>(c));
+        while (std::cin)
+        {
+            const auto at = pgm.size();
+            pgm.resize(at + chunk);
+            std::cin.read(pgm.data() + at, chunk);
+            pgm.resize(at + static_cast<size_t>(std::cin.gcount()));
+        }
         return pgm;
     }
 
@@ -120,14 +193,44 @@ static void write_bin(const std::string& filename, const char* data, const size_
     stream.close();
 }
 
+// symbols travel next to a binary in <binary>.sym, so a profile of it can name its labels
+static void write_symbols(const std::string& filename, const RiscVM::SymbolMap& symbols)
+{
+    std::ofstream stream(filename + ".sym");
+    RiscVM::WriteSymbols(stream, symbols);
+}
+
+static RiscVM::SymbolMap read_symbols(const std::string& filename)
+{
+    std::ifstream stream(filename + ".sym");
+    if (!stream.is_open())
+        return {};
+    return RiscVM::ReadSymbols(stream);
+}
+
 int main(const int argc, const char* const* argv)
 {
     RiscVM::ArgParser args({
         {"help", "print help and exit", {"-h", "--help"}},
-        {"in-type", "specify input filetype (asm, bin, elf, coff)", {"--in-type", "-it"}, false},
+        {"in-type", "specify input filetype (asm, bin, elf, coff, trace)", {"--in-type", "-it"}, false},
         {"out-type", "specify output filetype (bin, elf, coff)", {"--out-type", "-ot"}, false},
         {"output", "specify output filename", {"--output", "-o"}, false},
+        {"engine", "specify execution engine (switch, threaded, block, jit)", {"--engine", "-e"}, false},
         {"version", "print version", {"-v", "--version", "--info"}},
+        {"bench", "print executed instructions and MIPS after the run", {"-b", "--bench"}},
+        {"harts", "run the program on a machine with this many harts", {"--harts", "-j"}, false},
+        {"memory", "guest memory size in bytes, at least the program size", {"--memory", "-m"}, false},
+        {"guard", "fault guest accesses outside guest memory using guard pages", {"--guard", "-g"}},
+        {"check", "check guest loads and stores (none, bounds, alignment)", {"--check", "-c"}, false},
+        {"isa", "instruction set the guest may use (rv32i, rv32im)", {"--isa"}, false},
+        {"profile", "count executions per pc and block and print a hot-spot report", {"--profile", "-p"}},
+        {"flame", "profile guest calls and write folded stacks for flame graph tools to this file", {"--flame", "-f"}, false},
+        {"trace", "record the last retired instructions and write them to this file at the end", {"--trace", "-t"}, false},
+        {"trace-size", "number of instructions the trace keeps", {"--trace-size"}, false},
+        {"flush", "when guest console output reaches the host (line, size, exit)", {"--flush"}, false},
+        {"fuel", "stop each hart after about this many instructions", {"--fuel"}, false},
+        {"record", "log the effects of every ecall to this file", {"--record"}, false},
+        {"replay", "replay the ecalls logged in this file instead of calling the host", {"--replay"}, false},
     });
     args.Parse(argc, argv);
 
@@ -140,12 +243,105 @@ int main(const int argc, const char* const* argv)
         return 0;
     }
 
-    const auto& in_filename = args.Args.empty() ? "" : args.Args[0];
-    const auto& out_filename = args.Get("output");
-    const auto& in_type = args.Get("in-type", "asm");
-    const auto& out_type = args.Get("out-type", "bin");
+    const std::string in_filename = args.Args.empty() ? "" : args.Args[0];
+    const std::string out_filename = args.Get("output");
+    const std::string in_type = args.Get("in-type", "asm");
+    const std::string out_type = args.Get("out-type", "bin");
+    const std::string engine_name = args.Get("engine", "threaded");
+    const std::string harts_name = args.Get("harts", "1");
+    const std::string memory_name = args.Get("memory", "0");
+    const std::string check_name = args.Get("check", "none");
+    const std::string isa_name = args.Get("isa", "rv32im");
+    const std::string flush_name = args.Get("flush", "line");
+    const std::string fuel_name = args.Get("fuel");
+    instrumentation tools;
+    tools.profile = args.Flags["profile"];
+    tools.flame = args.Get("flame");
+    tools.trace = args.Get("trace");
+    tools.trace_size = std::stoull(args.Get("trace-size", "4194304"), nullptr, 0);
+    tools.record = args.Get("record");
+    const std::string replay_name = args.Get("replay");
+
+    RiscVM::Engine engine;
+    if (engine_name == "switch")
+        engine = RiscVM::Engine_Switch;
+    else if (engine_name == "threaded")
+        engine = RiscVM::Engine_Threaded;
+    else if (engine_name == "block")
+        engine = RiscVM::Engine_Block;
+    else if (engine_name == "jit")
+        engine = RiscVM::Engine_JIT;
+    else
+    {
+        std::cerr << "execution engine '" << engine_name << "' is not supported" << std::endl;
+        return 1;
+    }
+
+    if (tools.profile + !tools.flame.empty() + !tools.trace.empty() > 1)
+    {
+        std::cerr << "--profile, --flame and --trace cannot be combined" << std::endl;
+        return 1;
+    }
+
+    if (!tools.record.empty() && !replay_name.empty())
+    {
+        std::cerr << "--record and --replay cannot be combined" << std::endl;
+        return 1;
+    }
+
+    if (!replay_name.empty())
+    {
+        std::ifstream stream(replay_name, std::ios_base::in | std::ios_base::binary);
+        try
+        {
+            tools.replay = RiscVM::ECallLog::Read(stream);
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "failed to read ecall log: " << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    RiscVM::Check check;
+    if (check_name == "none")
+        check = RiscVM::Check_None;
+    else if (check_name == "bounds")
+        check = RiscVM::Check_Bounds;
+    else if (check_name == "alignment")
+        check = RiscVM::Check_Alignment;
+    else
+    {
+        std::cerr << "memory check '" << check_name << "' is not supported" << std::endl;
+        return 1;
+    }
+
+    RiscVM::Subset subset;
+    if (isa_name == "rv32i")
+        subset = RiscVM::Subset_RV32I;
+    else if (isa_name == "rv32im")
+        subset = RiscVM::Subset_RV32IM;
+    else
+    {
+        std::cerr << "instruction set '" << isa_name << "' is not supported" << std::endl;
+        return 1;
+    }
+
+    RiscVM::Console::Flushing flush;
+    if (flush_name == "line")
+        flush = RiscVM::Console::Flush_Line;
+    else if (flush_name == "size")
+        flush = RiscVM::Console::Flush_Size;
+    else if (flush_name == "exit")
+        flush = RiscVM::Console::Flush_Exit;
+    else
+    {
+        std::cerr << "flush policy '" << flush_name << "' is not supported" << std::endl;
+        return 1;
+    }
 
     std::vector<char> pgm;
+    RiscVM::SymbolMap symbols;
     if (in_type == "asm")
     {
         RiscVM::LinkInfo link_info
@@ -166,12 +362,14 @@ int main(const int argc, const char* const* argv)
             RiscVM::Assembler::Assemble(stream, link_info, pgm);
             stream.close();
         }
+        symbols = link_info.Symbols;
 
         if (!out_filename.empty())
         {
             if (out_type == "bin")
             {
                 write_bin(out_filename, pgm.data(), pgm.size());
+                write_symbols(out_filename, symbols);
             }
             else if (out_type == "elf")
             {
@@ -189,7 +387,28 @@ int main(const int argc, const char* const* argv)
     }
     else if (in_type == "bin")
     {
-        pgm = read_bin(in_filename);
+        // a single hart maps the file instead, see below
+        if (in_filename.empty() || std::stoul(harts_name) > 1)
+            pgm = read_bin(in_filename);
+        if (!in_filename.empty())
+            symbols = read_symbols(in_filename);
+    }
+    else if (in_type == "trace")
+    {
+        std::ifstream file;
+        if (!in_filename.empty())
+            file.open(in_filename, std::ios_base::in | std::ios_base::binary);
+        std::istream& stream = in_filename.empty() ? std::cin : file;
+        try
+        {
+            RiscVM::TraceBuffer::Print(std::cout, RiscVM::TraceBuffer::Read(stream));
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "failed to read trace: " << error.what() << std::endl;
+            return 1;
+        }
+        return 0;
     }
     else if (in_type == "elf")
     {
@@ -207,6 +426,44 @@ int main(const int argc, const char* const* argv)
         return 1;
     }
 
-    const auto status = exec(pgm.data(), pgm.size());
+    const auto harts = std::stoul(harts_name);
+    const auto memory_size = std::stoull(memory_name, nullptr, 0);
+    const auto fuel = fuel_name.empty() ? std::numeric_limits<uint64_t>::max() : std::stoull(fuel_name, nullptr, 0);
+    if (harts > 1)
+    {
+        if (tools.profile || !tools.flame.empty() || !tools.trace.empty())
+            std::cerr << "profiling and tracing need a single hart, running without" << std::endl;
+        if (!tools.record.empty() || tools.replay)
+            std::cerr << "recording and replaying ecalls need a single hart, running without" << std::endl;
+        const auto status = exec_harts(pgm.data(), pgm.size(), memory_size, engine, args.Flags["bench"], harts, check, subset, flush, fuel);
+        std::cout << "Exit Code " << status << std::endl;
+        return 0;
+    }
+
+    RiscVM::VM vm;
+    vm.GuardPages() = args.Flags["guard"];
+    vm.Checking() = check;
+    vm.ISASubset() = subset;
+    vm.IO().FlushPolicy() = flush;
+    vm.Fuel() = fuel;
+    // lets the recorder watch the pages each ecall writes instead of comparing all of memory
+    vm.DirtyTracking() = !tools.record.empty();
+    auto size = pgm.size();
+    if (in_type == "bin" && !in_filename.empty())
+    {
+        if (!vm.LoadFile(in_filename, memory_size))
+        {
+            std::cerr << "failed to open '" << in_filename << "'" << std::endl;
+            return 1;
+        }
+        std::error_code error;
+        size = std::filesystem::file_size(in_filename, error);
+        if (error)
+            size = vm.MemorySize();
+    }
+    else
+        vm.Load(pgm.data(), pgm.size(), memory_size);
+
+    const auto status = exec(vm, size, engine, args.Flags["bench"], tools, symbols);
     std::cout << "Exit Code " << status << std::endl;
 }